@@ -0,0 +1,335 @@
+/*
+ * LV2Automation.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Sample accurate control automation - Backend Agnostic
+ *
+ * Producers (UI, sequencer, control surface) stamp control changes with a
+ * host frame time and push them into their own lock-free queue. The audio
+ * thread merges the queues and splits the cycle at the due events, so a
+ * change lands on its frame instead of on the next period boundary.
+ *
+ * Splits are made on a grid of setBlockSize() frames: an event is applied
+ * up to one block early, never later, and no sub-block is shorter than the
+ * grid unless the period itself is. A block size of 1 is fully sample
+ * accurate.
+ *
+ * Optional host side ramps smooth the changes for plugins that zipper: a
+ * ramp updates the port every setRampStep() frames, linearly or with a
+ * constant ratio (exponential, for frequencies and gains). Ports without a
+ * ramp jump on their frame.
+ */
+
+#pragma once
+
+#include "lv2_ringbuffer.h"
+#include "LV2HostStats.hpp"
+
+#include <lv2/atom/atom.h>
+#include <lv2/atom/util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+enum class LV2RampCurve : uint8_t {
+    Linear,
+    Exponential     // linear when the end points differ in sign or touch 0
+};
+
+struct LV2AutomationEvent {
+    static constexpr uint64_t kNow = 0;                   // next cycle start
+    static constexpr uint32_t kDefaultRamp = UINT32_MAX;  // the port's smoothing
+
+    uint64_t frame = kNow;          // host frame time, see LV2Automation::frameTime()
+    uint32_t port = 0;
+    float value = 0.0f;
+    uint32_t ramp_frames = kDefaultRamp;    // 0 jumps
+    LV2RampCurve curve = LV2RampCurve::Linear;
+};
+
+// ============================================================================
+// LV2AutomationQueue - one producer thread, the audio thread consumes
+// ============================================================================
+
+// A producer pushes its events in frame order. An event stamped earlier
+// than one queued before it waits behind it and lands late.
+class LV2AutomationQueue {
+public:
+    explicit LV2AutomationQueue(size_t events)
+        : rb_(lv2_ringbuffer_create(next_power_of_two(events * sizeof(LV2AutomationEvent)))) {}
+
+    ~LV2AutomationQueue() { lv2_ringbuffer_free(rb_); }
+
+    LV2AutomationQueue(const LV2AutomationQueue&) = delete;
+    LV2AutomationQueue& operator=(const LV2AutomationQueue&) = delete;
+
+    // producer thread, false when the queue is full
+    bool push(const LV2AutomationEvent& ev) {
+        if (lv2_ringbuffer_write_space(rb_) < sizeof(ev)) return false;
+        lv2_ringbuffer_write(rb_, (const char*)&ev, sizeof(ev));
+        return true;
+    }
+
+    bool push(uint32_t port, float value, uint64_t frame = LV2AutomationEvent::kNow) {
+        LV2AutomationEvent ev;
+        ev.frame = frame;
+        ev.port = port;
+        ev.value = value;
+        return push(ev);
+    }
+
+    lv2_ringbuffer_t* ringbuffer() const { return rb_; }
+
+private:
+    friend class LV2Automation;
+
+    // audio thread
+    bool peek(LV2AutomationEvent& ev) const {
+        if (lv2_ringbuffer_read_space(rb_) < sizeof(ev)) return false;
+        lv2_ringbuffer_peek(rb_, (char*)&ev, sizeof(ev));
+        return true;
+    }
+
+    void pop() { lv2_ringbuffer_read_advance(rb_, sizeof(LV2AutomationEvent)); }
+
+    lv2_ringbuffer_t* rb_;
+};
+
+// ============================================================================
+// LV2Automation - event merge, cycle splitting and ramps
+// ============================================================================
+
+class LV2Automation {
+public:
+    static constexpr uint32_t kDefaultBlock = 16;
+    static constexpr uint32_t kDefaultRampStep = 64;
+
+    // ---- setup, before the audio thread runs ----
+
+    void init(uint32_t port_count, LV2HostStats* stats = nullptr) {
+        targets_.assign(port_count, nullptr);
+        ramps_.assign(port_count, Ramp{});
+        smoothing_.assign(port_count, Smoothing{});
+        active_.clear();
+        active_.reserve(port_count);
+        stats_ = stats;
+    }
+
+    // the control value the plugin port is connected to
+    void bind(uint32_t port, float* value) {
+        if (port < targets_.size()) targets_[port] = value;
+    }
+
+    // ramp applied to events sent with kDefaultRamp, 0 frames to jump
+    void setSmoothing(uint32_t port, uint32_t frames, LV2RampCurve curve = LV2RampCurve::Linear) {
+        if (port < smoothing_.size()) smoothing_[port] = Smoothing{ frames, curve };
+    }
+
+    void setBlockSize(uint32_t frames) { block_ = std::max(1u, frames); }
+    void setRampStep(uint32_t frames) { ramp_step_ = std::max(1u, frames); }
+
+    // one queue per producer thread, owned here
+    LV2AutomationQueue* addQueue(size_t events = 1024) {
+        queues_.push_back(std::make_unique<LV2AutomationQueue>(events));
+        Source src;
+        src.queue = queues_.back().get();
+        sources_.push_back(src);
+        return queues_.back().get();
+    }
+
+    void clear() {
+        sources_.clear();
+        queues_.clear();
+        targets_.clear();
+        ramps_.clear();
+        smoothing_.clear();
+        active_.clear();
+        now_ = 0;
+        frame_time_.store(0, std::memory_order_relaxed);
+    }
+
+    // any thread: host frame time of the next cycle start. Producers stamp
+    // events with frameTime() plus the lead they want.
+    uint64_t frameTime() const { return frame_time_.load(std::memory_order_acquire); }
+
+    // RT: frames the caller took in after the last process() that have
+    // not run yet, e.g. the partly filled FIFO of a fixed block length.
+    // frameTime() counts them, so producers stamp in their own time.
+    void setBuffered(uint32_t frames) {
+        frame_time_.store(now_ + frames, std::memory_order_release);
+    }
+
+    // RT: calls run(offset, frames) for consecutive sub-blocks covering
+    // [0, nframes), every control set for its block before the call
+    template <typename Run>
+    void process(uint32_t nframes, Run&& run) {
+        const uint64_t t0 = now_;
+        uint32_t pos = 0;
+        while (pos < nframes) {
+            // everything due within the next block lands now
+            apply_due(t0 + pos + block_);
+
+            uint32_t end = nframes;
+            uint64_t next;
+            if (next_frame(next) && next < t0 + nframes) {
+                const uint32_t ahead = (uint32_t)(next - t0) - pos;
+                end = pos + ahead / block_ * block_;
+            }
+            if (!active_.empty())
+                end = std::min(end, pos + std::max(ramp_step_ / block_, 1u) * block_);
+            // a tail shorter than the grid stays with this block, its event
+            // opens the next cycle
+            if (nframes - end < block_) end = nframes;
+
+            step_ramps(end - pos);
+            run(pos, end - pos);
+            pos = end;
+        }
+        now_ = t0 + nframes;
+        frame_time_.store(now_, std::memory_order_release);
+    }
+
+private:
+    struct Source {
+        LV2AutomationQueue* queue = nullptr;
+        LV2AutomationEvent head;
+        bool has_head = false;
+    };
+
+    struct Smoothing {
+        uint32_t frames = 0;
+        LV2RampCurve curve = LV2RampCurve::Linear;
+    };
+
+    struct Ramp {
+        float start = 0.0f, target = 0.0f;
+        uint32_t length = 0, done = 0;
+        bool exponential = false, active = false;
+    };
+
+    bool fill(Source& s) {
+        if (!s.has_head) s.has_head = s.queue->peek(s.head);
+        return s.has_head;
+    }
+
+    bool next_frame(uint64_t& frame) {
+        bool any = false;
+        for (auto& s : sources_) {
+            if (!fill(s)) continue;
+            if (!any || s.head.frame < frame) frame = s.head.frame;
+            any = true;
+        }
+        return any;
+    }
+
+    void apply_due(uint64_t limit) {
+        for (auto& s : sources_) {
+            while (fill(s) && s.head.frame < limit) {
+                // missed by more than the grid tolerance
+                if (s.head.frame != LV2AutomationEvent::kNow && s.head.frame + block_ <= now_ && stats_)
+                    LV2HostStats::inc(stats_->automation_late);
+                apply(s.head);
+                s.queue->pop();
+                s.has_head = false;
+            }
+        }
+    }
+
+    void apply(const LV2AutomationEvent& ev) {
+        if (ev.port >= targets_.size() || !targets_[ev.port]) return;
+        const Smoothing& sm = smoothing_[ev.port];
+        const bool use_default = ev.ramp_frames == LV2AutomationEvent::kDefaultRamp;
+        const uint32_t length = use_default ? sm.frames : ev.ramp_frames;
+        const LV2RampCurve curve = use_default ? sm.curve : ev.curve;
+        Ramp& r = ramps_[ev.port];
+        if (length == 0) {
+            *targets_[ev.port] = ev.value;
+            deactivate(ev.port);
+            return;
+        }
+        r.start = *targets_[ev.port];
+        r.target = ev.value;
+        r.length = length;
+        r.done = 0;
+        r.exponential = curve == LV2RampCurve::Exponential && r.start * r.target > 0.0f;
+        if (!r.active) {
+            r.active = true;
+            active_.push_back(ev.port);
+        }
+    }
+
+    // each ramping port takes the value it reaches at the end of the block
+    void step_ramps(uint32_t frames) {
+        for (size_t k = 0; k < active_.size();) {
+            const uint32_t port = active_[k];
+            Ramp& r = ramps_[port];
+            r.done = std::min(r.length, r.done + frames);
+            const float t = (float)r.done / (float)r.length;
+            if (r.done >= r.length) {
+                *targets_[port] = r.target;
+                r.active = false;
+                active_[k] = active_.back();
+                active_.pop_back();
+                continue;
+            }
+            *targets_[port] = r.exponential ? r.start * std::pow(r.target / r.start, t)
+                                            : r.start + (r.target - r.start) * t;
+            ++k;
+        }
+    }
+
+    void deactivate(uint32_t port) {
+        if (!ramps_[port].active) return;
+        ramps_[port].active = false;
+        auto it = std::find(active_.begin(), active_.end(), port);
+        if (it != active_.end()) {
+            *it = active_.back();
+            active_.pop_back();
+        }
+    }
+
+    std::vector<std::unique_ptr<LV2AutomationQueue>> queues_;
+    std::vector<Source> sources_;
+    std::vector<float*> targets_;
+    std::vector<Ramp> ramps_;
+    std::vector<Smoothing> smoothing_;
+    std::vector<uint32_t> active_;      // ramping ports, reserved for all
+    LV2HostStats* stats_ = nullptr;
+
+    uint32_t block_ = kDefaultBlock;
+    uint32_t ramp_step_ = kDefaultRampStep;
+    uint64_t now_ = 0;
+    std::atomic<uint64_t> frame_time_{0};
+};
+
+// ============================================================================
+// Sub-block helpers
+// ============================================================================
+
+// RT: copy the events of src stamped in [begin, end) into dst, shifted to
+// begin. The last slice of a cycle passes end = UINT32_MAX. capacity is the
+// body size of dst, events that do not fit are left out.
+static inline void lv2_sequence_slice(const LV2_Atom_Sequence* src, LV2_Atom_Sequence* dst,
+                                      uint32_t capacity, uint32_t begin, uint32_t end) {
+    dst->atom.type = src->atom.type;
+    dst->atom.size = sizeof(LV2_Atom_Sequence_Body);
+    dst->body = src->body;
+    LV2_ATOM_SEQUENCE_FOREACH(src, ev) {
+        const int64_t t = ev->time.frames;
+        if (t < begin) continue;
+        if (t >= end) break;
+        const uint32_t size = sizeof(LV2_Atom_Event) + ev->body.size;
+        const uint32_t padded = lv2_atom_pad_size(size);
+        if (dst->atom.size + padded > capacity) break;
+        LV2_Atom_Event* out = lv2_atom_sequence_end(&dst->body, dst->atom.size);
+        memcpy(out, ev, size);
+        out->time.frames = t - begin;
+        dst->atom.size += padded;
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * LV2BlockAdapter.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Block size adapter - Backend Agnostic
+ *
+ * A plugin is told the largest block it will see (bufsz:maxBlockLength),
+ * the backend delivers whatever it likes: Oboe callbacks vary from burst to
+ * burst. process() cuts a callback into plugin runs of at most block()
+ * frames, without copying.
+ *
+ * In fixed mode every run is exactly block() frames long, for plugins that
+ * require bufsz:fixedBlockLength or bufsz:powerOf2BlockLength and for FFT
+ * plugins that work best at one size. Input collects in a FIFO while the
+ * output of the previous block plays out, which adds latency() frames.
+ */
+
+#pragma once
+
+#include "LV2Interleave.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// LV2BlockAdapter - split callbacks, or run at one fixed size through a FIFO
+// ============================================================================
+
+class LV2BlockAdapter {
+public:
+    static constexpr uint32_t kMaxChannels = 64;
+
+    // non-RT: runs of at most (fixed: exactly) `block` frames. The FIFO of
+    // fixed mode holds `channels`, splitting takes up to kMaxChannels.
+    void configure(uint32_t channels, uint32_t block, bool fixed) {
+        channels_ = std::min(channels, kMaxChannels);
+        block_ = std::max(1u, block);
+        fixed_ = fixed;
+        pos_ = 0;
+        if (fixed_) {
+            fifo_in_.allocate(channels_, block_);
+            fifo_out_.allocate(channels_, block_);
+        }
+    }
+
+    uint32_t block() const { return block_; }
+    // most channels process() passes on
+    uint32_t channels() const { return fixed_ ? channels_ : kMaxChannels; }
+    bool fixed() const { return fixed_; }
+
+    // frames between a sample entering process() and leaving it
+    uint32_t latency() const { return fixed_ ? block_ : 0; }
+
+    // frames of the next fixed block already in the FIFO, 0 when splitting
+    uint32_t fill() const { return pos_; }
+
+    // drop what the FIFO holds, e.g. after a stream restart
+    void reset() {
+        pos_ = 0;
+        if (!fixed_) return;
+        memset(fifo_in_.data(), 0, fifo_in_.bytes());
+        memset(fifo_out_.data(), 0, fifo_out_.bytes());
+    }
+
+    // RT: calls run(in, out, frames) with channel pointers for every plugin
+    // block. in and out may be the same buffers.
+    template <typename Run>
+    void process(float* const* in, float* const* out, uint32_t channels,
+                 uint32_t nframes, Run&& run) {
+        channels = std::min(channels, this->channels());
+        if (!fixed_) {
+            if (nframes <= block_) {
+                run(in, out, nframes);
+                return;
+            }
+            for (uint32_t off = 0; off < nframes; off += block_) {
+                for (uint32_t c = 0; c < channels; ++c) {
+                    in_ptrs_[c] = in[c] + off;
+                    out_ptrs_[c] = out[c] + off;
+                }
+                run(in_ptrs_.data(), out_ptrs_.data(), std::min(block_, nframes - off));
+            }
+            return;
+        }
+
+        uint32_t done = 0;
+        while (done < nframes) {
+            const uint32_t n = std::min(block_ - pos_, nframes - done);
+            // all inputs first, in and out may alias
+            for (uint32_t c = 0; c < channels; ++c)
+                memcpy(fifo_in_.channel(c) + pos_, in[c] + done, n * sizeof(float));
+            for (uint32_t c = 0; c < channels; ++c)
+                memcpy(out[c] + done, fifo_out_.channel(c) + pos_, n * sizeof(float));
+            pos_ += n;
+            done += n;
+            if (pos_ == block_) {
+                run(fifo_in_.channels(), fifo_out_.channels(), block_);
+                pos_ = 0;
+            }
+        }
+    }
+
+private:
+    PlanarBuffers fifo_in_, fifo_out_;
+    std::array<float*, kMaxChannels> in_ptrs_{};
+    std::array<float*, kMaxChannels> out_ptrs_{};
+    uint32_t channels_ = 0;
+    uint32_t block_ = 1;
+    uint32_t pos_ = 0;
+    bool fixed_ = false;
+};
@@ -0,0 +1,85 @@
+/*
+ * LV2Denormals.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Denormal protection - Backend Agnostic
+ *
+ * IIR filters and reverb tails decay into the denormal range, where every
+ * float operation can cost a hundred times more. protect() switches the
+ * calling thread to flush-to-zero / denormals-are-zero (MXCSR.FTZ|DAZ on x86,
+ * FPCR.FZ on AArch64). The floating point environment is per thread, and
+ * backends may move their callback to a new thread, so hosts call it on every
+ * callback entry: it is one register read when the mode is already set.
+ *
+ * takeFlags() reads and clears the sticky denormal/underflow flags. Hosts
+ * call it around run() to count the cycles in which a plugin produced or
+ * consumed denormals. Whether a flush still raises the underflow flag is
+ * CPU specific, so with protection on the count may stay at zero.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define LV2_DENORMALS_SSE 1
+#elif defined(__aarch64__)
+#define LV2_DENORMALS_AARCH64 1
+#endif
+
+// ============================================================================
+// LV2Denormals - FTZ/DAZ and the sticky denormal flags of this thread
+// ============================================================================
+
+class LV2Denormals {
+public:
+    static constexpr bool supported() {
+#if defined(LV2_DENORMALS_SSE) || defined(LV2_DENORMALS_AARCH64)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // RT safe, any thread
+    static void protect() {
+#if defined(LV2_DENORMALS_SSE)
+        const uint32_t csr = _mm_getcsr();
+        if ((csr & kModeBits) != kModeBits) _mm_setcsr(csr | kModeBits);
+#elif defined(LV2_DENORMALS_AARCH64)
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        if (!(fpcr & kModeBits)) __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | kModeBits));
+#endif
+    }
+
+    // RT safe: true when a denormal was read or an underflow flushed since
+    // the last call on this thread, clears the flags
+    static bool takeFlags() {
+#if defined(LV2_DENORMALS_SSE)
+        const uint32_t csr = _mm_getcsr();
+        if (!(csr & kFlagBits)) return false;
+        _mm_setcsr(csr & ~kFlagBits);
+        return true;
+#elif defined(LV2_DENORMALS_AARCH64)
+        uint64_t fpsr;
+        __asm__ __volatile__("mrs %0, fpsr" : "=r"(fpsr));
+        if (!(fpsr & kFlagBits)) return false;
+        __asm__ __volatile__("msr fpsr, %0" : : "r"(fpsr & ~kFlagBits));
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+#if defined(LV2_DENORMALS_SSE)
+    static constexpr uint32_t kModeBits = 0x8040;     // FTZ (15) | DAZ (6)
+    static constexpr uint32_t kFlagBits = 0x0012;     // UE (4) | DE (1)
+#elif defined(LV2_DENORMALS_AARCH64)
+    static constexpr uint64_t kModeBits = 1ull << 24; // FPCR.FZ
+    static constexpr uint64_t kFlagBits = 0x88;       // FPSR.IDC (7) | UFC (3)
+#endif
+};
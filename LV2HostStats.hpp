@@ -0,0 +1,83 @@
+/*
+ * LV2HostStats.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Host instrumentation - Backend Agnostic
+ *
+ * Counters written by the audio thread with relaxed atomics and read from
+ * any other thread. Readers take a snapshot() and diff two of them to get
+ * per second rates.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// ============================================================================
+// LV2HostStats - RT side counters
+// ============================================================================
+
+struct LV2HostStats {
+    std::atomic<uint64_t> cycles{0};            // process callbacks
+    std::atomic<uint64_t> port_reconnects{0};   // connect_port calls in RT
+    std::atomic<uint64_t> worker_no_space{0};   // worker messages rejected, ring full
+    std::atomic<uint64_t> worker_dropped{0};    // worker messages larger than the scratch
+    std::atomic<uint64_t> denormal_cycles{0};   // run() calls that raised denormal flags
+    std::atomic<uint64_t> midi_in_dropped{0};   // MIDI events that did not fit the port
+    std::atomic<uint64_t> midi_out_dropped{0};  // MIDI events the backend refused
+    std::atomic<uint64_t> automation_late{0};   // automation events applied after their frame
+    std::atomic<uint64_t> idle_cycles{0};       // run() calls the idle gate skipped
+
+    static void inc(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+        counter.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    struct Snapshot {
+        std::chrono::steady_clock::time_point time;
+        uint64_t cycles = 0;
+        uint64_t port_reconnects = 0;
+        uint64_t worker_no_space = 0;
+        uint64_t worker_dropped = 0;
+        uint64_t denormal_cycles = 0;
+        uint64_t midi_in_dropped = 0;
+        uint64_t midi_out_dropped = 0;
+        uint64_t automation_late = 0;
+        uint64_t idle_cycles = 0;
+
+        // events per second between an older snapshot and this one
+        double rate(uint64_t Snapshot::*field, const Snapshot& older) const {
+            const double sec = std::chrono::duration<double>(time - older.time).count();
+            return sec > 0.0 ? (this->*field - older.*field) / sec : 0.0;
+        }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot s;
+        s.time = std::chrono::steady_clock::now();
+        s.cycles = cycles.load(std::memory_order_relaxed);
+        s.port_reconnects = port_reconnects.load(std::memory_order_relaxed);
+        s.worker_no_space = worker_no_space.load(std::memory_order_relaxed);
+        s.worker_dropped = worker_dropped.load(std::memory_order_relaxed);
+        s.denormal_cycles = denormal_cycles.load(std::memory_order_relaxed);
+        s.midi_in_dropped = midi_in_dropped.load(std::memory_order_relaxed);
+        s.midi_out_dropped = midi_out_dropped.load(std::memory_order_relaxed);
+        s.automation_late = automation_late.load(std::memory_order_relaxed);
+        s.idle_cycles = idle_cycles.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    void reset() {
+        cycles.store(0, std::memory_order_relaxed);
+        port_reconnects.store(0, std::memory_order_relaxed);
+        worker_no_space.store(0, std::memory_order_relaxed);
+        worker_dropped.store(0, std::memory_order_relaxed);
+        denormal_cycles.store(0, std::memory_order_relaxed);
+        midi_in_dropped.store(0, std::memory_order_relaxed);
+        midi_out_dropped.store(0, std::memory_order_relaxed);
+        automation_late.store(0, std::memory_order_relaxed);
+        idle_cycles.store(0, std::memory_order_relaxed);
+    }
+};
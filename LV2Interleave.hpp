@@ -0,0 +1,151 @@
+/*
+ * LV2Interleave.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Interleave kernels - Backend Agnostic
+ *
+ * Converts between the interleaved frames of a device callback and the planar
+ * per channel buffers LV2 audio ports are connected to. Stereo, the common
+ * case, uses SSE or NEON four frames at a time; other channel counts use a
+ * plain loop. Unaligned loads/stores, so any buffer works.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define LV2_INTERLEAVE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LV2_INTERLEAVE_NEON 1
+#endif
+
+// ============================================================================
+// Stereo kernels
+// ============================================================================
+
+static inline void lv2_deinterleave2(const float* in, float* l, float* r, uint32_t n) {
+    uint32_t i = 0;
+#if defined(LV2_INTERLEAVE_SSE)
+    for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(in + 2 * i);        // l0 r0 l1 r1
+        const __m128 b = _mm_loadu_ps(in + 2 * i + 4);    // l2 r2 l3 r3
+        _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif defined(LV2_INTERLEAVE_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t v = vld2q_f32(in + 2 * i);
+        vst1q_f32(l + i, v.val[0]);
+        vst1q_f32(r + i, v.val[1]);
+    }
+#endif
+    for (; i < n; ++i) {
+        l[i] = in[2 * i];
+        r[i] = in[2 * i + 1];
+    }
+}
+
+static inline void lv2_interleave2(const float* l, const float* r, float* out, uint32_t n) {
+    uint32_t i = 0;
+#if defined(LV2_INTERLEAVE_SSE)
+    for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(l + i);
+        const __m128 b = _mm_loadu_ps(r + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(a, b));
+    }
+#elif defined(LV2_INTERLEAVE_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4x2_t v;
+        v.val[0] = vld1q_f32(l + i);
+        v.val[1] = vld1q_f32(r + i);
+        vst2q_f32(out + 2 * i, v);
+    }
+#endif
+    for (; i < n; ++i) {
+        out[2 * i] = l[i];
+        out[2 * i + 1] = r[i];
+    }
+}
+
+// ============================================================================
+// N channel kernels
+// ============================================================================
+
+static inline void lv2_deinterleave(const float* in, float* const* planar,
+                                    uint32_t channels, uint32_t n) {
+    if (channels == 2) {
+        lv2_deinterleave2(in, planar[0], planar[1], n);
+    } else if (channels == 1) {
+        memcpy(planar[0], in, n * sizeof(float));
+    } else {
+        for (uint32_t c = 0; c < channels; ++c) {
+            float* dst = planar[c];
+            for (uint32_t i = 0; i < n; ++i) dst[i] = in[i * channels + c];
+        }
+    }
+}
+
+static inline void lv2_interleave(const float* const* planar, float* out,
+                                  uint32_t channels, uint32_t n) {
+    if (channels == 2) {
+        lv2_interleave2(planar[0], planar[1], out, n);
+    } else if (channels == 1) {
+        memcpy(out, planar[0], n * sizeof(float));
+    } else {
+        for (uint32_t c = 0; c < channels; ++c) {
+            const float* src = planar[c];
+            for (uint32_t i = 0; i < n; ++i) out[i * channels + c] = src[i];
+        }
+    }
+}
+
+// ============================================================================
+// PlanarBuffers - one buffer per device channel plus silence and scratch
+// ============================================================================
+
+// Surplus plugin inputs read silence(), surplus outputs write scratch(), so
+// every audio port is connected to a valid buffer whatever the device has.
+class PlanarBuffers {
+public:
+    void allocate(uint32_t channels, uint32_t frames) {
+        channels_ = channels;
+        frames_ = frames;
+        // 64 byte aligned channel starts
+        stride_ = (frames + 15) & ~15u;
+        data_.reset(static_cast<float*>(aligned_alloc(64, bytes())));
+        memset(data_.get(), 0, bytes());
+        ptrs_.reset(new float*[channels ? channels : 1]);
+        for (uint32_t c = 0; c < channels; ++c) ptrs_[c] = channel(c);
+    }
+
+    float* channel(uint32_t c) const { return data_.get() + (size_t)c * stride_; }
+    float* silence() const { return channel(channels_); }
+    float* scratch() const { return channel(channels_ + 1); }
+    float* const* channels() const { return ptrs_.get(); }
+
+    uint32_t channelCount() const { return channels_; }
+    uint32_t frames() const { return frames_; }
+
+    // the whole allocation, for locking it
+    float* data() const { return data_.get(); }
+    size_t bytes() const { return (size_t)(channels_ + 2) * stride_ * sizeof(float); }
+
+private:
+    struct FreeDelete {
+        void operator()(float* p) const { free(p); }
+    };
+
+    std::unique_ptr<float, FreeDelete> data_;
+    std::unique_ptr<float*[]> ptrs_;
+    uint32_t channels_ = 0;
+    uint32_t frames_ = 0;
+    uint32_t stride_ = 0;
+};
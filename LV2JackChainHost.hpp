@@ -0,0 +1,416 @@
+
+/*
+ * LV2JackChainHost.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2026 brummer <brummer@web.de>
+ */
+
+
+/****************************************************************
+        LV2JackChainHost.hpp - run a LV2PluginGraph inside a
+                               single JACK client (headless)
+
+****************************************************************/
+
+#pragma once
+
+#include <jack/jack.h>
+#include <semaphore.h>
+
+#include "LV2PluginGraph.hpp"
+#include "LV2PluginCache.hpp"
+#include "LV2RTMemory.hpp"
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+/****************************************************************
+        LV2JackChainHost - one JACK client, many plugins,
+                           scheduled once per period
+
+****************************************************************/
+
+class LV2JackChainHost {
+public:
+    explicit LV2JackChainHost() {}
+
+    ~LV2JackChainHost() {
+        closeHost();
+    }
+
+    // with the discovery cache the world starts empty and resolve() loads
+    // the bundles of every chain plugin on demand
+    bool init(const char* client_name = "luma-chain", uint32_t num_channels = 2) {
+        // every plugin buffer allocated from here on stays resident
+        LV2RTMemory::lockAll();
+        world = lilv_world_new();
+        if (use_cache && !plugin_cache.refresh())
+            std::cerr << "Warning: could not write " << plugin_cache.path() << "\n";
+        if (!use_cache) lilv_world_load_all(world);
+        plugs = lilv_world_get_all_plugins(world);
+
+        jack = jack_client_open(client_name, JackNullOption, nullptr);
+        if (!jack) return false;
+
+        channels = num_channels;
+        jack_set_process_callback(jack, jack_process, this);
+        jack_set_thread_init_callback(jack, jack_thread_init, this);
+        jack_set_latency_callback(jack, jack_latency, this);
+        jack_set_xrun_callback(jack, jack_xrun, this);
+        jack_set_buffer_size_callback(jack, jack_buffer_size, this);
+        srate = jack_get_sample_rate(jack);
+        graph.reset(new LV2PluginGraph(world, srate, jack_get_buffer_size(jack), channels));
+        graph->setWorkerSize(worker_size);
+        graph->setDenormalProtection(denormal_protection);
+        return register_ports();
+    }
+
+    void set_use_cache(bool on) { use_cache = on; }
+
+    // resolve a plugin by exact URI or case-insensitive name
+    std::string resolve(const std::string& input) {
+        if (use_cache) {
+            std::string uri;
+            std::string needle = input;
+            std::transform(needle.begin(), needle.end(), needle.begin(), ::tolower);
+            for (const auto& m : plugin_cache.matches(input)) {
+                std::string name = m.second;
+                std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+                if (m.first == input || name == needle) {
+                    uri = m.first;
+                    break;
+                }
+            }
+            if (!uri.empty()) plugin_cache.loadInto(world, uri);
+            return uri;
+        }
+
+        std::string needle = input;
+        std::transform(needle.begin(), needle.end(), needle.begin(), ::tolower);
+
+        LILV_FOREACH(plugins, i, plugs) {
+            const LilvPlugin* p = lilv_plugins_get(plugs, i);
+            std::string uri = lilv_node_as_uri(lilv_plugin_get_uri(p));
+            if (uri == input) return uri;
+            const LilvNode* name_node = lilv_plugin_get_name(p);
+            std::string name = name_node ? lilv_node_as_string(name_node) : "";
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            if (name == needle) return uri;
+        }
+        return std::string();
+    }
+
+    bool add_serial(const std::string& uri) {
+        std::string resolved = resolve(uri);
+        if (resolved.empty()) {
+            std::cerr << "Plugin not found: " << uri << "\n";
+            return false;
+        }
+        return graph->addSerial(resolved);
+    }
+
+    bool add_parallel(const std::vector<std::vector<std::string>>& branches) {
+        std::vector<std::vector<std::string>> resolved(branches.size());
+        for (size_t b = 0; b < branches.size(); ++b) {
+            for (const auto& uri : branches[b]) {
+                std::string r = resolve(uri);
+                if (r.empty()) {
+                    std::cerr << "Plugin not found: " << uri << "\n";
+                    return false;
+                }
+                resolved[b].push_back(r);
+            }
+        }
+        return graph->addParallel(resolved);
+    }
+
+    // worker threads for parallel branches, -1 picks one per extra branch
+    // limited by the available cores, 0 keeps everything on the JACK thread
+    void set_threads(int n) { threads = n; }
+
+    // skip run() of plugins that stay silent for tail_seconds, 0 = off
+    void set_idle_bypass(float tail_seconds) { idle_tail = tail_seconds; }
+
+    // largest worker message and flush-to-zero of every chain plugin,
+    // before init()
+    void set_worker_size(uint32_t bytes) { worker_size = bytes; }
+    void set_denormal_protection(bool on) { denormal_protection = on; }
+
+    // ramp the control changes of every chain plugin over ms, 0 = off
+    void set_control_smoothing(float ms) { smooth_ms = ms; }
+
+    // cycle timing, DSP load histogram and xruns of the whole chain,
+    // before activate()
+    void set_perf_stats(bool on) { if (on) perf.enable(); }
+    LV2PerfMonitor& getPerf() { return perf; }
+
+    // save the state of the whole chain to dir every seconds, 0 = off
+    void set_autosave(const std::string& dir, float seconds) {
+        autosave_dir = dir;
+        autosave_seconds = seconds;
+    }
+
+    // on the graph state thread, the audio keeps running
+    void save_snapshot(const std::string& dir) {
+        graph->saveSnapshot(dir, [dir](bool ok) {
+            std::cout << (ok ? "Saved " : "Could not save ") << dir << "\n";
+        });
+    }
+
+    void load_snapshot(const std::string& dir) {
+        graph->loadSnapshot(dir, [dir](bool ok) {
+            std::cout << (ok ? "Loaded " : "Could not load ") << dir << "\n";
+        });
+    }
+
+    bool activate() {
+        if (!jack || !graph || graph->getPluginCount() == 0) return false;
+        graph->setIdleBypass(idle_tail);
+        if (smooth_ms > 0.0f) graph->setControlSmoothing(smooth_ms);
+        if (autosave_seconds > 0.0f && !autosave_dir.empty()) {
+            const std::string dir = autosave_dir;
+            graph->setAutosave(dir, std::chrono::milliseconds((int64_t)(autosave_seconds * 1000.0f)),
+                [dir](bool ok) {
+                    if (!ok) std::cerr << "Autosave to " << dir << " failed\n";
+                });
+        }
+        graph->prepare();
+        start_latency_thread();
+        // the pool is built before the process callback can run the graph
+        start_workers();
+        if (jack_activate(jack) != 0) return false;
+        perf.start();
+        return true;
+    }
+
+    size_t plugin_count() const { return graph ? graph->getPluginCount() : 0; }
+
+    // frames the chain delays its output by, as published on the ports
+    uint32_t latency() const { return reported_latency.load(std::memory_order_acquire); }
+
+    void closeHost() {
+        if (jack) {
+            jack_deactivate(jack);
+            stop_latency_thread();
+            for (auto* p : in_ports) jack_port_unregister(jack, p);
+            for (auto* p : out_ports) jack_port_unregister(jack, p);
+            in_ports.clear();
+            out_ports.clear();
+            jack_client_close(jack);
+            jack = nullptr;
+        }
+        perf.stop();
+        // plugins go before the world they were discovered in
+        graph.reset();
+        if (world) {
+            lilv_world_free(world);
+            world = nullptr;
+        }
+    }
+
+private:
+
+/****************************************************************
+        JACK - register the chain ports and run the graph
+
+****************************************************************/
+
+    bool register_ports() {
+        for (uint32_t c = 0; c < channels; ++c) {
+            std::string n = std::to_string(c + 1);
+            jack_port_t* in = jack_port_register(jack, ("in_" + n).c_str(),
+                                JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+            jack_port_t* out = jack_port_register(jack, ("out_" + n).c_str(),
+                                JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+            if (!in || !out) return false;
+            in_ports.push_back(in);
+            out_ports.push_back(out);
+        }
+        in_bufs.resize(channels);
+        out_bufs.resize(channels);
+        return true;
+    }
+
+    // the workers run with the scheduling class of the JACK process
+    // thread, which the client reports before jack_activate()
+    void start_workers() {
+        uint32_t workers = threads < 0 ? 0 : (uint32_t)threads;
+        if (threads < 0) {
+            const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+            workers = (uint32_t)std::min<size_t>(cores - 1, graph->getMaxParallelism() - 1);
+        }
+        if (!workers) return;
+
+        int policy = SCHED_OTHER;
+        int priority = 0;
+        if (jack_is_realtime(jack)) {
+            policy = SCHED_FIFO;
+            priority = jack_client_real_time_priority(jack);
+            if (priority < 0) {
+                policy = SCHED_OTHER;
+                priority = 0;
+            }
+        }
+        if (graph->setWorkerThreads(workers, policy, priority))
+            std::cout << "Chain: " << graph->getWorkerThreads() << " worker threads\n";
+    }
+
+    static int jack_process(jack_nframes_t n, void* arg) {
+        return static_cast<LV2JackChainHost*>(arg)->process(n);
+    }
+
+    static int jack_xrun(void* arg) {
+        static_cast<LV2JackChainHost*>(arg)->perf.xrun();
+        return 0;
+    }
+
+    // the plugins keep the block length they were instantiated with, the
+    // graph runs a longer period in several blocks
+    static int jack_buffer_size(jack_nframes_t nframes, void* arg) {
+        auto* host = static_cast<LV2JackChainHost*>(arg);
+        const uint32_t block = host->graph ? host->graph->getMaxBlockLength() : 0;
+        if (block && nframes > block)
+            std::cerr << "Chain: JACK period of " << nframes << " frames runs in blocks of "
+                      << block << "\n";
+        return 0;
+    }
+
+    static void jack_thread_init(void*) {
+        LV2RTMemory::prefaultStack();
+    }
+
+    static void jack_latency(jack_latency_callback_mode_t mode, void* arg) {
+        static_cast<LV2JackChainHost*>(arg)->set_port_latencies(mode);
+    }
+
+    // non-RT: channel c adds the chain latency between in_c and out_c
+    void set_port_latencies(jack_latency_callback_mode_t mode) {
+        const uint32_t latency = reported_latency.load(std::memory_order_acquire);
+        for (uint32_t c = 0; c < channels; ++c) {
+            const bool capture = mode == JackCaptureLatency;
+            jack_port_t* from = capture ? in_ports[c] : out_ports[c];
+            jack_port_t* to = capture ? out_ports[c] : in_ports[c];
+            jack_latency_range_t range;
+            jack_port_get_latency_range(from, mode, &range);
+            range.min += latency;
+            range.max += latency;
+            jack_port_set_latency_range(to, mode, &range);
+        }
+    }
+
+/****************************************************************
+        LATENCY - recompute the JACK graph latencies off RT
+                  whenever the chain latency changes
+
+****************************************************************/
+
+    void start_latency_thread() {
+        reported_latency.store(graph->getLatency(), std::memory_order_release);
+        posted_overruns = graph->getCompensationOverruns();
+        sem_init(&latency_wake, 0, 0);
+        latency_running.store(true, std::memory_order_release);
+        latency_thread = std::thread([this, overruns = posted_overruns]() mutable {
+            while (true) {
+                sem_wait(&latency_wake);
+                if (!latency_running.load(std::memory_order_acquire)) break;
+                jack_recompute_total_latencies(jack);
+                // the branch lags are set before process() posts
+                const uint64_t now = graph->getCompensationOverruns();
+                if (now != overruns)
+                    std::cerr << "Chain: a branch lags its stage by more than the "
+                                 "latency compensation covers, the branches are misaligned\n";
+                overruns = now;
+            }
+        });
+    }
+
+    // after jack_deactivate(), the process callback no longer posts
+    void stop_latency_thread() {
+        if (!latency_thread.joinable()) return;
+        latency_running.store(false, std::memory_order_release);
+        sem_post(&latency_wake);
+        latency_thread.join();
+        sem_destroy(&latency_wake);
+    }
+
+    int process(jack_nframes_t nframes) {
+        LV2CycleRecord cycle;
+        const bool timed = perf.enabled();
+        if (timed) cycle.start_ns = LV2PerfMonitor::now();
+        for (uint32_t c = 0; c < channels; ++c) {
+            in_bufs[c] = (float*)jack_port_get_buffer(in_ports[c], nframes);
+            out_bufs[c] = (float*)jack_port_get_buffer(out_ports[c], nframes);
+        }
+        uint64_t run_start = 0;
+        uint64_t denormals = 0;
+        if (timed) {
+            // the plugins sample and clear the flags around their run(),
+            // possibly on pool workers, so their counts are compared
+            denormals = graph->getDenormalCycles();
+            run_start = LV2PerfMonitor::now();
+        }
+        graph->process(in_bufs.data(), out_bufs.data(), nframes);
+        if (timed) {
+            const uint64_t end = LV2PerfMonitor::now();
+            if (graph->getDenormalCycles() != denormals) cycle.flags |= LV2CycleRecord::kDenormal;
+            cycle.frames = nframes;
+            cycle.run_ns = (uint32_t)(end - run_start);
+            cycle.budget_ns = (uint32_t)(1e9 * nframes / srate);
+            cycle.cycle_ns = (uint32_t)(end - cycle.start_ns);
+            perf.record(cycle);
+        }
+        // a plugin reported a new latency, or a branch lag went past the
+        // compensation, sem_post() is RT safe
+        const uint32_t latency = graph->getLatency();
+        const uint64_t overruns = graph->getCompensationOverruns();
+        if (latency != reported_latency.load(std::memory_order_relaxed) ||
+            overruns != posted_overruns) {
+            reported_latency.store(latency, std::memory_order_release);
+            posted_overruns = overruns;
+            sem_post(&latency_wake);
+        }
+        return 0;
+    }
+
+/****************************************************************
+        HOST DATA - private host data members
+
+****************************************************************/
+
+    LilvWorld* world = nullptr;
+    const LilvPlugins* plugs = nullptr;
+    LV2PluginCache plugin_cache;
+    bool use_cache = true;
+
+    jack_client_t* jack = nullptr;
+    double srate = 48000.0;
+    uint32_t channels = 2;
+    int threads = -1;
+    float idle_tail = 0.0f;
+    uint32_t worker_size = 0;
+    bool denormal_protection = true;
+    float smooth_ms = 0.0f;
+    LV2PerfMonitor perf;
+    std::string autosave_dir;
+    float autosave_seconds = 0.0f;
+    std::vector<jack_port_t*> in_ports;
+    std::vector<jack_port_t*> out_ports;
+    std::vector<const float*> in_bufs;
+    std::vector<float*> out_bufs;
+
+    std::atomic<uint32_t> reported_latency{0};
+    uint64_t posted_overruns = 0;           // process() only
+    std::atomic<bool> latency_running{false};
+    sem_t latency_wake;
+    std::thread latency_thread;
+
+    std::unique_ptr<LV2PluginGraph> graph;
+};
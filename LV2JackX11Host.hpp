@@ -11,6 +11,9 @@
 /****************************************************************
         LV2JackX11Host.h - a LV2 Host for X11 based plugins
 
+        the plugin runs in LV2Plugin, this is the JACK I/O policy
+        for LV2PluginHost plus the X11 UI
+
 ****************************************************************/
 
 //  g++ -g main.cpp -o lv2host `pkg-config --cflags --libs jack lilv-0 x11` -ldl
@@ -20,31 +23,28 @@
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
-#ifdef __ANDROID__
-#include <oboe/Oboe.h>
-#endif
-
 #include "lv2_ringbuffer.h"
+#include "LV2PluginHost.hpp"
+#include "LV2HostStats.hpp"
+#include "LV2RTMemory.hpp"
+#include "LV2URIDMap.hpp"
+#include "LV2PluginCache.hpp"
 #include <lilv/lilv.h>
 
 #include <lv2/ui/ui.h>
 #include <lv2/urid/urid.h>
 #include <lv2/atom/atom.h>
-#include <lv2/atom/util.h>
-#include <lv2/atom/forge.h>
-#include <lv2/midi/midi.h>
 #include <lv2/options/options.h>
 #include <lv2/parameters/parameters.h>
-#include <lv2/buf-size/buf-size.h>
-#include <lv2/patch/patch.h>
-#include <lv2/worker/worker.h>
-#include <lv2/state/state.h>
-#include <lv2/resize-port/resize-port.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <dlfcn.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include <vector>
@@ -55,9 +55,9 @@
 #include <cstring>
 #include <cstdlib>
 #include <thread>
-#include <cassert>
 #include <ctime>
 #include <algorithm>
+#include <limits>
 #include <iostream>
 
 /****************************************************************
@@ -65,9 +65,14 @@
 
 ****************************************************************/
 
-class LV2X11JackHost {
+class LV2X11JackHost : public LV2PluginHost<LV2X11JackHost> {
 public:
-    explicit LV2X11JackHost() {}
+    explicit LV2X11JackHost() {
+        um.handle = &LV2URIDMap::instance();
+        um.map = LV2URIDMap::mapCallback;
+        unm.handle = &LV2URIDMap::instance();
+        unm.unmap = LV2URIDMap::unmapCallback;
+    }
 
     ~LV2X11JackHost() {
         closeHost();
@@ -79,34 +84,52 @@ public:
         plugs = lilv_world_get_all_plugins(world);
     }
 
-    bool init(const char* uri) {
-        plugin_uri = uri;
-        if (!world) init_world();
-        return init_lilv()
-            && init_jack()
-            && init_ports(true)
-            && init_instance();
+    // load only the bundles the discovery cache lists for one plugin,
+    // falls back to the whole world when the plugin isn't cached
+    void init_world_for(const char* uri) {
+        if (!use_cache || !plugin_cache.find(uri)) {
+            init_world();
+            return;
+        }
+        world = lilv_world_new();
+        plugin_cache.loadInto(world, uri);
+        plugs = lilv_world_get_all_plugins(world);
     }
 
-    bool init_no_jack(const char* uri, double sample_rate, uint32_t max_block) {
+    // --no-cache: always scan the whole LV2 path with lilv
+    void set_use_cache(bool on) { use_cache = on; }
+
+    // linked mode: n copies of the plugin in this one client, e.g. a mono
+    // effect on every channel of a bus. Each copy has its own audio ports
+    // (symbol_1 ... symbol_n) and worker, they share the control values,
+    // MIDI and atom input and the UI. Only the first copy's control and
+    // atom outputs reach the UI and the MIDI outputs. Call before init().
+    void set_instance_count(uint32_t n) { instance_count = std::max(1u, n); }
+    uint32_t get_instance_count() const { return instance_count; }
+
+    bool init(const char* uri) {
         plugin_uri = uri;
-        if (!world) init_world();
-        max_block_length = max_block;
-        return init_lilv()
-            && init_ports(false)
-            && init_instance(sample_rate);
+        if (!world) init_world_for(uri);
+        const bool ok = init_lilv()
+            && init_jack()
+            && init_plugin()
+            && init_ports();
+        if (ok) setup_rt_memory();
+        return ok;
     }
 
     bool initUi() {
-        return init_ui()
-            && jack_activate(jack) == 0;
+        // before the process callback can signal it
+        ui_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (!init_ui()) return false;
+        start_latency_thread();
+        if (jack_activate(jack) != 0) return false;
+        dsp_active = true;
+        perf_.start();
+        return true;
     }
 
     void closeHost() {
-        if (instance) {
-            lilv_instance_deactivate(instance);
-        }
-        stop_worker();
         destroy_ui();
         if (ui_dl) {
             dlclose(ui_dl);
@@ -114,31 +137,27 @@ public:
         }
 
         if (jack) {
-            for (auto& p : ports) {
-                if (p.is_audio) {
-                    if (jack_port_connected(p.jack_port)) {
-                        jack_port_disconnect(jack,p.jack_port);
-                    }
-                    jack_port_unregister(jack,p.jack_port);
-                }
-                if (p.is_atom &&  p.is_midi) {
-                    if (jack_port_connected(p.jack_port)) {
-                        jack_port_disconnect(jack,p.jack_port);
-                    }
-                    jack_port_unregister(jack,p.jack_port);
+            // no process callback from here on, it uses the ports
+            jack_deactivate(jack);
+            stop_latency_thread();
+            for (jack_port_t* port : jack_ports) {
+                if (jack_port_connected(port)) {
+                    jack_port_disconnect(jack, port);
                 }
+                jack_port_unregister(jack, port);
             }
-
-            jack_deactivate(jack);
             jack_client_close(jack);
             jack = nullptr;
         }
-
-        if (instance) {
-            lilv_instance_free(instance);
-            instance = nullptr;
+        perf_.stop();
+        if (ui_wake_fd >= 0) {
+            close(ui_wake_fd);
+            ui_wake_fd = -1;
         }
 
+        closePlugin();
+        dsp_active = false;
+
         if (x_display) {
             if (x_window) {
                 XDestroyWindow(x_display, x_window);
@@ -148,18 +167,21 @@ public:
             x_display = nullptr;
         }
 
-        for (auto& p : ports) {
-            if (p.atom)
-                free(p.atom);
-            delete p.atom_state;
-        }
-        ports.clear();
+        jack_ports.clear();
+        audio_in_ports.clear();
+        audio_out_ports.clear();
+        midi_in.clear();
+        midi_out.clear();
+        ui_drains.clear();
 
+        for (auto& s : preset_states) lilv_state_free(s.second);
+        preset_states.clear();
         if (world) {
-            freeNodes();
+            if (x11_class) lilv_node_free(x11_class);
+            x11_class = nullptr;
             lilv_world_free(world);
             world = nullptr;
-        }        
+        }
     }
 
 /****************************************************************
@@ -178,8 +200,43 @@ public:
         int idle_counter = 0;
         bool resize_enabled = false;
 
+        // block on X events, the idle tick and the process callback's eventfd
+        const int tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        bool mapped = true;
+        set_idle_timer(tick_fd, ui_idle_rate);
+        pollfd fds[3] = {
+            { ConnectionNumber(x_display), POLLIN, 0 },
+            { tick_fd, POLLIN, 0 },
+            { ui_wake_fd, POLLIN, 0 },
+        };
+        // DSP driven wakeups re-arm no earlier than this
+        auto rearm_at = std::chrono::steady_clock::now();
+        ui_wake_armed.store(true, std::memory_order_release);
+
         while (run.load()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(16)); // ~60 FPS
+            // XPending() flushes our requests; events Xlib already queued
+            // would never show up on the fd, so only block without them
+            if (!XPending(x_display)) {
+                int timeout = -1;
+                if (!ui_wake_armed.load(std::memory_order_acquire)) {
+                    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        rearm_at - std::chrono::steady_clock::now()).count();
+                    timeout = left > 0 ? (int)left : 0;
+                }
+                poll(fds, 3, timeout);
+            }
+            uint64_t count = 0;
+            const bool tick = read(tick_fd, &count, sizeof(count)) == sizeof(count);
+            const bool woken = ui_wake_fd >= 0 &&
+                               read(ui_wake_fd, &count, sizeof(count)) == sizeof(count);
+            const auto now = std::chrono::steady_clock::now();
+            if (woken) {
+                const float rate = mapped ? ui_dsp_rate : ui_hidden_rate;
+                rearm_at = now + std::chrono::microseconds((int64_t)(1e6f / std::max(rate, 0.1f)));
+            }
+            if (!ui_wake_armed.load(std::memory_order_relaxed) && now >= rearm_at)
+                ui_wake_armed.store(true, std::memory_order_release);
+
             while (XPending(x_display)) {
                 XEvent ev;
                 XNextEvent(x_display, &ev);
@@ -189,10 +246,15 @@ public:
                         fprintf(stderr, "Exit\n");
                         shutdown.store(true, std::memory_order_release);
                         run.store(false, std::memory_order_release);
+                        close(tick_fd);
                         closeHost();
                         return;
                     }
                 }
+                if (ev.type == MapNotify || ev.type == UnmapNotify) {
+                    mapped = ev.type == MapNotify;
+                    set_idle_timer(tick_fd, mapped ? ui_idle_rate : ui_hidden_rate);
+                }
                 if (ev.type == ConfigureNotify) {
                     XConfigureEvent xev = ev.xconfigure;
                     if (xev.width != wx || xev.height != wy) {
@@ -207,33 +269,34 @@ public:
             if (ui_dirty.exchange(false)) send_control_outputs();
             if (ui_needs_initial_update.exchange(false))
                 send_initial_ui_values();
-            if (ui_needs_control_update.exchange(false))
+            handle_program_change();
+            // a restored state reached the plugin
+            const bool restored = plugin_->takeRestoredValues();
+            if (ui_needs_control_update.exchange(false) || restored)
                 send_control_values();
 
-            for (auto& p : ports) {
-                if (!p.is_atom || p.is_input) continue;
-
-                auto* rb = p.atom_state->dsp_to_ui;
-                while (lv2_ringbuffer_read_space(rb) >= sizeof(LV2_Atom)) {
-                    LV2_Atom hdr;
-                    lv2_ringbuffer_peek(rb, (char*)&hdr, sizeof(LV2_Atom));
-                    const uint32_t total = sizeof(LV2_Atom) + hdr.size;
-                    if (lv2_ringbuffer_read_space(rb) < total) break;
-                    std::vector<uint8_t> buf(total);
-                    lv2_ringbuffer_read(rb, (char*)buf.data(), total);
-                    ui_desc->port_event(ui_handle, p.index, total,
-                                urids.atom_eventTransfer, buf.data());
-                }
-            }
-            // run plugin UI idle loop
-            if (idle) {
+            for (uint32_t k = 0; k < ui_drains.size(); ++k)
+                forward_atoms_to_ui(k);
+            // run plugin UI idle loop on the tick, and right after new
+            // DSP data so the UI redraws it without waiting for the tick
+            if (idle && (tick || woken)) {
                 idle->idle(ui_handle);
-                if (!resize_enabled) {
+                if (!resize_enabled && tick) {
                     idle_counter++;
                     if (idle_counter > 30) resize_enabled = true;
                 }
             }
         }
+        close(tick_fd);
+    }
+
+    static void set_idle_timer(int fd, float hz) {
+        const long ns = (long)(1e9f / std::max(hz, 0.1f));
+        itimerspec spec;
+        spec.it_interval.tv_sec = ns / 1000000000L;
+        spec.it_interval.tv_nsec = ns % 1000000000L;
+        spec.it_value = spec.it_interval;
+        timerfd_settime(fd, 0, &spec, nullptr);
     }
 
 /****************************************************************
@@ -245,6 +308,16 @@ public:
     std::vector<std::pair<std::string, std::string>>
                     find_plugin_matches(const std::string& input) {
 
+        if (use_cache) {
+            if (!cache_refreshed) {
+                if (!plugin_cache.refresh())
+                    std::cerr << "Warning: could not write " << plugin_cache.path() << "\n";
+                cache_refreshed = true;
+            }
+            return plugin_cache.matches(input);
+        }
+        if (!world) init_world();
+
         // uri / name
         std::vector<std::pair< std::string, std::string >> results;
         // lowercase input
@@ -289,8 +362,139 @@ public:
         std::string label;
     };
 
+    // labels only: the cache has them already, else they are read from
+    // the preset manifests. Preset bodies load on first use in apply_preset().
     std::vector<PresetInfo> get_presets(const char* plugin_uri) {
 
+        std::vector<PresetInfo> result;
+        if (use_cache && plugin_cache.find(plugin_uri)) {
+            for (auto& s : plugin_cache.presetsFor(plugin_uri))
+                result.push_back({ s.uri, s.label });
+        } else {
+            result = find_presets(plugin_uri);
+        }
+
+        std::sort(result.begin(), result.end(),
+            [](const PresetInfo& a, const PresetInfo& b) {
+                return a.label < b.label;
+            });
+        // MIDI program change n selects preset_index[n]
+        preset_index = result;
+        return result;
+    }
+
+/****************************************************************
+            STATE - load a preset
+
+****************************************************************/
+
+    // Load (once) and restore a preset. Port values reach the plugin as
+    // one snapshot at the next period boundary, never halfway through a
+    // cycle; see LV2Plugin::restoreState().
+    void apply_preset(std::string presetUri, std::string presetLabel) {
+        const LilvState* state = load_preset_state(presetUri, presetLabel);
+        if (!state || !plugin_) {
+            ui_needs_initial_update.store(true);
+            return ;
+        }
+        preset_uri = presetUri;
+        preset_label = presetLabel;
+
+        plugin_->restoreState(state);
+        // the UI reads the values back once they reached the plugin
+        if (!dsp_active) ui_needs_control_update.store(true);
+        ui_needs_initial_update.store(false);
+    }
+
+    // MIDI program changes on the plugin's MIDI inputs switch presets,
+    // program n picks the n-th entry of get_presets()
+    void set_program_change_presets(bool on) { program_change_presets = on; }
+
+    // RT counters, safe to read from any thread
+    const LV2HostStats& getStats() const {
+        static const LV2HostStats none;
+        return plugin_ ? plugin_->getStats() : none;
+    }
+
+    // port index by symbol, hashed, LV2UI_INVALID_PORT_INDEX when unknown
+    uint32_t find_port(const char* symbol) const {
+        const uint32_t i = plugin_ ? plugin_->findPort(symbol) : UINT32_MAX;
+        return i != UINT32_MAX ? i : LV2UI_INVALID_PORT_INDEX;
+    }
+
+    // largest worker message in bytes, call before init()
+    void set_worker_size(uint32_t bytes) { worker_size = bytes; }
+
+    // MIDI events per frame a MIDI port buffer holds, call before init().
+    // 1.0 covers dense MPE and 14-bit CC streams.
+    void set_midi_event_density(float events_per_frame) { midi_event_density = events_per_frame; }
+
+    // flush-to-zero/denormals-are-zero on the process and worker
+    // threads, on by default. Call before init().
+    void set_denormal_protection(bool on) { denormal_protection = on; }
+
+    // time every process cycle, call before initUi(). The monitor
+    // aggregates off RT, set its onReport()/exportShared() before initUi().
+    void set_perf_stats(bool on) { if (on) perf_.enable(); }
+
+    // skip run() once the audio inputs and outputs stayed below threshold
+    // for tail_seconds plus the plugin latency, with no MIDI, atom or
+    // control change; the outputs are silent meanwhile. 0 = off (default).
+    // Call after init(), before initUi().
+    void set_idle_bypass(float tail_seconds,
+                         float threshold = LV2IdleGate::kDefaultThreshold) {
+        if (plugin_) plugin_->setIdleBypass(tail_seconds, threshold);
+    }
+
+    // frames the plugin reports on its lv2:reportsLatency output plus the
+    // block latency, as published on the JACK ports
+    uint32_t get_latency() const { return plugin_latency.load(std::memory_order_acquire); }
+
+    // timestamped control changes, split process cycles and ramps, see
+    // LV2Automation.hpp. Set smoothing, block size and add one queue per
+    // producer thread after init(), before initUi(). UI writes use a
+    // queue of their own.
+    LV2Automation& get_automation() { return plugin_->getAutomation(); }
+
+    // host side ramps on the continuous control inputs, 0 ms jumps.
+    // Toggle, trigger, integer and enumeration ports always jump.
+    // Call after init().
+    void set_control_smoothing(float ms, LV2RampCurve curve = LV2RampCurve::Linear) {
+        if (plugin_) plugin_->setControlSmoothing(ms, curve);
+    }
+
+    // max UI notifications per second for every control output,
+    // 0 = whenever the value changes. Call before init().
+    void set_ui_output_rate(float hz) { ui_output_rate = hz; }
+
+    // plugin UI idle() calls per second while the window is mapped, and
+    // while it is unmapped (minimized, other workspace)
+    void set_ui_idle_rate(float visible_hz, float hidden_hz = 4.0f) {
+        ui_idle_rate = visible_hz;
+        ui_hidden_rate = hidden_hz;
+    }
+
+    // same for a single control output port, after init()
+    void set_ui_output_rate(uint32_t port_index, float hz) {
+        if (!plugin_) return;
+        const auto& out = plugin_->getPortTables().control_out;
+        for (size_t k = 0; k < out.size(); ++k)
+            if (out[k] == port_index)
+                control_outputs[k].interval = (hz > 0.0f && sample_rate_ > 0.0)
+                                            ? (uint32_t)(sample_rate_ / hz) : 0;
+    }
+
+private:
+    friend class LV2PluginHost<LV2X11JackHost>;
+
+/****************************************************************
+            PRESET STATE - presets parsed once, restored
+                           by the plugin on every apply
+
+****************************************************************/
+
+    std::vector<PresetInfo> find_presets(const char* plugin_uri) {
+
         std::vector<PresetInfo> result;
         LilvNode* uri = lilv_new_uri(world, plugin_uri);
 
@@ -321,11 +525,15 @@ public:
 
         LILV_FOREACH(nodes, i, presets) {
             const LilvNode* preset = lilv_nodes_get(presets, i);
-            // load preset into world
-            lilv_world_load_resource(world, preset);
             PresetInfo info;
             info.uri = lilv_node_as_uri(preset);
             LilvNode* label = lilv_world_get(world, preset, label_pred, nullptr);
+            // the label is in the manifest for most bundles, only load
+            // the preset resource when it isn't
+            if (!label) {
+                lilv_world_load_resource(world, preset);
+                label = lilv_world_get(world, preset, label_pred, nullptr);
+            }
 
             if (label && lilv_node_is_string(label)) {
                 info.label = lilv_node_as_string(label);
@@ -339,772 +547,498 @@ public:
         lilv_node_free(label_pred);
         lilv_node_free(preset_class);
         lilv_node_free(uri);
-
-        std::sort(result.begin(), result.end(),
-            [](const PresetInfo& a, const PresetInfo& b) {
-                return a.label < b.label;
-            });
         return result;
     }
 
-/****************************************************************
-            STATE - load a preset
-
-****************************************************************/
-
-    static void set_port_value(const char* port_symbol, void* user_data,
-                   const void* value, uint32_t size, uint32_t type) {
-
-        (void) size;
-        (void) type;
-        auto* self = static_cast<LV2X11JackHost*>(user_data);
-        for (auto& p : self->ports) {
-            if (!p.is_control) continue;
-            if (strcmp(p.symbol, port_symbol) == 0) {
-                if (size == sizeof(float)) p.control = *(const float*)value;
-                break;
-            }
-        }
-    }
-
-    static char* make_path_func(LV2_State_Make_Path_Handle, const char* path) {
-        return strdup(path);
-    }
-
-    static char* map_path_func(LV2_State_Map_Path_Handle, const char* abstract_path) {
-        return strdup(abstract_path);
-    }
-
-    static void free_path_func(LV2_State_Free_Path_Handle, char* path) {
-        free(path);
-    }
-
-    LV2_State_Map_Path map_path;
-    LV2_State_Make_Path make_path;
-    LV2_State_Free_Path free_path;
-
-    void apply_preset(std::string presetUri, std::string presetLabel) {
-        preset_uri = presetUri;
-        preset_label = presetLabel;
+    // non-RT: parse a preset once, later calls return the cached state
+    const LilvState* load_preset_state(const std::string& uri,
+                                       const std::string& label) {
+        auto it = preset_states.find(uri);
+        if (it != preset_states.end()) return it->second;
 
-        LilvNode* preset = lilv_new_uri(world, preset_uri.c_str());
+        LilvNode* preset = lilv_new_uri(world, uri.c_str());
         if (!preset) {
             fprintf(stderr, "Invalid preset URI\n");
-            ui_needs_initial_update.store(true);
-            return ;
+            return nullptr;
         }
-
+        lilv_world_load_resource(world, preset);
         LilvState* state = lilv_state_new_from_world(world, &um, preset);
+        lilv_node_free(preset);
 
         if (!state) {
-            char* path = lilv_file_uri_parse(preset_uri.c_str(), nullptr);
+            char* path = lilv_file_uri_parse(uri.c_str(), nullptr);
             if (!path) {
-                fprintf(stderr, "Preset not found\n");
-                lilv_node_free(preset);
-                ui_needs_initial_update.store(true);
-                return ;
+                fprintf(stderr, "Preset not found: %s\n", label.c_str());
+                return nullptr;
             }
-
-            LilvState* state = lilv_state_new_from_file(world, &um, nullptr, path);
+            state = lilv_state_new_from_file(world, &um, nullptr, path);
             free(path);
-
             if (!state) {
-                fprintf(stderr, "Failed to load preset\n");
-                lilv_node_free(preset);
-                ui_needs_initial_update.store(true);
-                return ;
+                fprintf(stderr, "Failed to load preset: %s\n", label.c_str());
+                return nullptr;
             }
         }
-
-        const LV2_Feature* feat[] = {
-            &features.um_f,
-            &features.unm_f,
-            &features.map_path_feature,
-            &features.make_path_feature,
-            &features.free_path_feature,
-            &host_worker.feature,
-            nullptr
-        };
-
-        lilv_state_restore(state, instance, set_port_value, this, 0, feat);
-
-        lilv_state_free(state);
-        lilv_node_free(preset);
-
-        ui_needs_control_update.store(true);
-        ui_needs_initial_update.store(false);
+        preset_states.emplace(uri, state);
+        return state;
     }
 
-private:
+    // non-RT, from the UI loop: serve a program change seen by process()
+    void handle_program_change() {
+        const int program = requested_program.exchange(-1, std::memory_order_acquire);
+        if (program < 0) return;
+        if (preset_index.empty()) get_presets(plugin_uri);
+        if ((size_t)program >= preset_index.size()) return;
+        const PresetInfo& p = preset_index[program];
+        apply_preset(p.uri, p.label);
+    }
 
 /****************************************************************
-                        WORKER
+                        PORT DATA
 
 ****************************************************************/
 
-    struct WorkerRequest {
-        uint32_t size;
-        uint8_t  data[0];
+    // a JACK MIDI port and the plugin port it feeds or reads
+    struct MidiPort {
+        uint32_t index = 0;             // plugin port
+        jack_port_t* jack_port = nullptr;
+        void* buffer = nullptr;         // this period's JACK buffer
+        uint32_t count = 0;             // inputs: events this period
+        uint32_t next = 0;              // inputs: first event not staged yet
     };
 
-    struct WorkerResponse {
-        uint32_t size;
-        uint8_t  data[0];
+    // control outputs: last value published to the UI and rate limit
+    struct ControlOutput {
+        float sent = std::numeric_limits<float>::quiet_NaN();
+        uint32_t interval = 0;          // min frames between notifications
+        uint32_t holdoff = 0;           // frames left until the next one
     };
 
-    struct LV2HostWorker {
-        lv2_ringbuffer_t* requests = nullptr;
-        lv2_ringbuffer_t* responses = nullptr;
-
-        LV2_Worker_Schedule schedule;
-        LV2_Feature feature;
-        const LV2_Worker_Interface* iface = nullptr;
-        LV2_Handle dsp_handle;
+    // UI side: one frame worth of dsp_to_ui messages, reused every frame
+    struct UIDrain {
+        struct Msg {
+            uint32_t offset;    // into buf
+            uint64_t key;       // LV2Plugin::patchSetKey(), 0 = always delivered
+        };
+        // open addressed key -> last msg, a slot is used when it
+        // carries the stamp of the current frame
+        struct Latest {
+            uint64_t key;
+            uint32_t msg;
+            uint32_t stamp;
+        };
+        std::vector<uint8_t> buf;
+        std::vector<Msg> msgs;
+        std::vector<Latest> latest;
+        uint32_t stamp = 0;
+
+        // a patch:Set takes more than 16 bytes of the ring, so the
+        // table never gets more than half full
+        void reserve(size_t ring_size) {
+            size_t n = 16;
+            while (n < ring_size / 16) n <<= 1;
+            latest.assign(n, Latest{ 0, 0, 0 });
+            msgs.reserve(ring_size / sizeof(LV2_Atom));
+        }
 
-        std::atomic<bool> running{false};;
-        std::atomic<bool> work_pending{false};;
-        std::thread worker_thread;
+        // starts a frame, forgets every key of the last one
+        void next_frame() {
+            msgs.clear();
+            if (++stamp) return;
+            for (Latest& l : latest) l.stamp = 0;
+            stamp = 1;
+        }
 
-        std::vector<uint8_t> response_buffer;
+        Latest& find(uint64_t key) {
+            const size_t mask = latest.size() - 1;
+            size_t i = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+            while (latest[i].stamp == stamp && latest[i].key != key) i = (i + 1) & mask;
+            return latest[i];
+        }
     };
 
-    // store work request in ringbuffer
-    static LV2_Worker_Status host_schedule_work(
-                        LV2_Worker_Schedule_Handle handle,
-                        uint32_t size, const void* data) {
-
-        auto* w = (LV2HostWorker*)handle;
-        const size_t total = sizeof(uint32_t) + size;
-        if (lv2_ringbuffer_write_space(w->requests) < total)
-            return LV2_WORKER_ERR_NO_SPACE;
-
-        lv2_ringbuffer_write(w->requests, (const char*)&size, sizeof(uint32_t));
-        lv2_ringbuffer_write(w->requests, (const char*)data, size);
-        w->work_pending.store(true, std::memory_order_release); 
-
-        return LV2_WORKER_SUCCESS;
-    }
-
-    // worker thread, check if work is to be done, and do it
-    static void worker_thread_func(LV2HostWorker* w) {
-        while (w->running.load()) {
-            if (lv2_ringbuffer_read_space(w->requests) < sizeof(uint32_t)) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                continue;
-            }
-
-            if (lv2_ringbuffer_read_space(w->requests) < sizeof(uint32_t)) {
-                continue;
-            }
-
-            uint32_t size;
-            lv2_ringbuffer_peek(w->requests, (char*)&size, sizeof(uint32_t));
+    // one bit per PortTables::control_out entry, set by RT when the value
+    // changed, taken by the UI thread
+    struct DirtyBits {
+        std::unique_ptr<std::atomic<uint64_t>[]> words;
+        size_t count = 0;
 
-            if (lv2_ringbuffer_read_space(w->requests) < sizeof(uint32_t) + size) {
-                 continue;
-            }
-
-            lv2_ringbuffer_read(w->requests, (char*)&size, sizeof(uint32_t));
-            std::vector<uint8_t> buf(size);
-            lv2_ringbuffer_read(w->requests, (char*)buf.data(), size);
-            w->iface->work(w->dsp_handle, host_respond, w, size, buf.data());
+        void resize(size_t bits) {
+            count = (bits + 63) / 64;
+            words.reset(new std::atomic<uint64_t>[count]);
+            for (size_t w = 0; w < count; ++w) words[w].store(0, std::memory_order_relaxed);
         }
-    }
-
-    // store response in ringbuffer when work is done
-    static LV2_Worker_Status host_respond(
-                        LV2_Worker_Respond_Handle handle,
-                        uint32_t size, const void* data) {
-
-        auto* w = (LV2HostWorker*)handle;
-        const size_t total = sizeof(uint32_t) + size;
-
-        if (lv2_ringbuffer_write_space(w->responses) < total)
-            return LV2_WORKER_ERR_NO_SPACE;
-
-        lv2_ringbuffer_write(w->responses, (const char*)&size, sizeof(uint32_t));
-
-        lv2_ringbuffer_write(w->responses,(const char*)data, size);
-
-        return LV2_WORKER_SUCCESS;
-    }
-
-    // inform plugin when work is done
-    void deliver_worker_responses(LV2HostWorker* w) {
-        constexpr size_t kDrainChunk = 256;
-        uint8_t scratch[kDrainChunk];
-        while (true) {
-            if (lv2_ringbuffer_read_space(w->responses) < sizeof(uint32_t)) break;
-
-            uint32_t size;
-            lv2_ringbuffer_peek(w->responses, (char*)&size, sizeof(uint32_t));
 
-            if (lv2_ringbuffer_read_space(w->responses) < sizeof(uint32_t) + size) break;
-
-            lv2_ringbuffer_read(w->responses, (char*)&size, sizeof(uint32_t));
-
-            if (size <= w->response_buffer.size()) {
-                lv2_ringbuffer_read(w->responses, (char*)w->response_buffer.data(), size);
-                w->iface->work_response(w->dsp_handle, size, w->response_buffer.data());
-                continue;
-            }
-
-            size_t remaining = size;
-            while (remaining > 0) {
-                const size_t chunk = std::min(remaining, kDrainChunk);
-                lv2_ringbuffer_read(w->responses, (char*)scratch, chunk);
-                remaining -= chunk;
-            }
+        void set(size_t bit) {
+            words[bit >> 6].fetch_or(uint64_t(1) << (bit & 63), std::memory_order_release);
         }
-    }
 
-    // stop worker thread on exit
-    void stop_worker() {
-        if (!host_worker.running.exchange(false))
-            return;
+        uint64_t take(size_t w) {
+            return words[w].exchange(0, std::memory_order_acquire);
+        }
+    };
 
-        if (host_worker.worker_thread.joinable())
-            host_worker.worker_thread.join();
+/****************************************************************
+        LILV - find the plugin and the X11 UI class
 
-        if (host_worker.requests) {
-            lv2_ringbuffer_free(host_worker.requests);
-            host_worker.requests = nullptr;
-        }
+****************************************************************/
 
-        if (host_worker.responses) {
-            lv2_ringbuffer_free(host_worker.responses);
-            host_worker.responses = nullptr;
-        }
+    bool init_lilv() {
+        LilvNode* uri = lilv_new_uri(world, plugin_uri);
+        lilv_plugin = lilv_plugins_get_by_uri(plugs, uri);
+        lilv_node_free(uri);
+        if (!lilv_plugin) return false;
+        plugin_name = "lv2-x11-host";
+        const LilvNode* nd = lilv_plugin_get_name(lilv_plugin);
+        if (nd) plugin_name = lilv_node_as_string(nd);
 
-        host_worker.iface = nullptr;
-        host_worker.dsp_handle = nullptr;
+        x11_class = lilv_new_uri(world, LV2_UI__X11UI);
+        return true;
     }
 
-    LV2HostWorker host_worker;
-
 /****************************************************************
-                        PORT DATA
+        JACK - check if jack is running and open client
 
 ****************************************************************/
 
-    struct AtomState {
-        std::vector<uint8_t> ui_to_dsp;
-        uint32_t ui_to_dsp_type = 0;
-        std::atomic<bool> ui_to_dsp_pending{false};
+    static int jack_process(jack_nframes_t n, void* arg) {
+        return static_cast<LV2X11JackHost*>(arg)->process(n);
+    }
+
+    static int jack_xrun(void* arg) {
+        static_cast<LV2X11JackHost*>(arg)->perf_.xrun();
+        return 0;
+    }
 
-        lv2_ringbuffer_t* dsp_to_ui = nullptr;
+    // runs on the process thread before its first cycle
+    static void jack_thread_init(void*) {
+        LV2RTMemory::prefaultStack();
+    }
 
-        AtomState(size_t sz = 16384) {
-            dsp_to_ui = lv2_ringbuffer_create(sz);
-        }
+    static void jack_latency(jack_latency_callback_mode_t mode, void* arg) {
+        static_cast<LV2X11JackHost*>(arg)->set_port_latencies(mode);
+    }
 
-        ~AtomState() {
-            lv2_ringbuffer_free(dsp_to_ui);
+    // non-RT: the capture latency of the inputs plus the plugin latency
+    // goes to the outputs, the playback latency of the outputs plus the
+    // plugin latency to the inputs. The range is the first copy's, the
+    // other copies are usually wired to unrelated channels.
+    void set_port_latencies(jack_latency_callback_mode_t mode) {
+        const bool capture = mode == JackCaptureLatency;
+        const std::vector<jack_port_t*>& from = capture ? input_ports : output_ports;
+        const std::vector<jack_port_t*>& to = capture ? output_ports : input_ports;
+        const size_t primary = capture ? primary_inputs : primary_outputs;
+        jack_latency_range_t range { UINT32_MAX, 0 };
+        for (size_t k = 0; k < primary; ++k) {
+            jack_latency_range_t r;
+            jack_port_get_latency_range(from[k], mode, &r);
+            range.min = std::min(range.min, r.min);
+            range.max = std::max(range.max, r.max);
         }
-    };
-
-    struct Port {
-        uint32_t index = 0;
-        bool is_audio = false;
-        bool is_input = false;
-        bool is_control = false;
-        bool is_atom = false;
-        bool is_midi = false;
-
-        float control = 0.0f;
-        float defvalue = 0.0f;
-        jack_port_t* jack_port = nullptr;
+        if (range.min > range.max) range.min = range.max = 0;
+        const uint32_t latency = get_latency();
+        range.min += latency;
+        range.max += latency;
+        for (jack_port_t* port : to) jack_port_set_latency_range(port, mode, &range);
+    }
 
-        LV2_Atom_Sequence* atom = nullptr;
-        uint32_t atom_buf_size = 8192;
-        AtomState* atom_state = nullptr;
+    bool init_jack() {
+        jack = jack_client_open(plugin_name.data(), JackNullOption, nullptr);
+        if (!jack) return false;
 
-        std::string uri;
-        const char* symbol = nullptr;
-    };
+        jack_set_process_callback(jack, jack_process, this);
+        jack_set_xrun_callback(jack, jack_xrun, this);
+        jack_set_thread_init_callback(jack, jack_thread_init, this);
+        jack_set_latency_callback(jack, jack_latency, this);
+        max_block_length = jack_get_buffer_size(jack);
+        return true;
+    }
 
 /****************************************************************
-                        URIDs
+        LATENCY - recompute the JACK graph latencies off RT
+                  whenever the plugin latency changes
 
 ****************************************************************/
 
-    struct {
-        LV2_URID atom_eventTransfer;
-        LV2_URID atom_Sequence;
-        LV2_URID atom_Object;
-        LV2_URID atom_Float;
-        LV2_URID atom_Int;
-        LV2_URID atom_Double;
-        LV2_URID midi_Event;
-        LV2_URID buf_maxBlock;
-        LV2_URID atom_Path;
-        LV2_URID patch_Get;
-        LV2_URID patch_Set;
-        LV2_URID patch_property;
-        LV2_URID patch_value;
-        LV2_URID atom_Blank;
-        LV2_URID atom_Chunk;
-        LV2_URID param_sampleRate;
-    } urids;
-
-    void init_urids() {
-        urids.atom_eventTransfer = map_uri(this, LV2_ATOM__eventTransfer);
-        urids.atom_Sequence    = map_uri(this, LV2_ATOM__Sequence);
-        urids.atom_Blank       = map_uri(this, LV2_ATOM__Blank);
-        urids.atom_Chunk       = map_uri(this, LV2_ATOM__Chunk);
-        urids.atom_Object      = map_uri(this, LV2_ATOM__Object);
-        urids.atom_Float       = map_uri(this, LV2_ATOM__Float);
-        urids.atom_Int         = map_uri(this, LV2_ATOM__Int);
-        urids.atom_Double      = map_uri(this, LV2_ATOM__Double);
-        urids.midi_Event       = map_uri(this, LV2_MIDI__MidiEvent);
-        urids.buf_maxBlock     = map_uri(this, LV2_BUF_SIZE__maxBlockLength);
-        urids.atom_Path        = map_uri(this, LV2_ATOM__Path);
-
-        urids.patch_Get        = map_uri(this, LV2_PATCH__Get);
-        urids.patch_Set        = map_uri(this, LV2_PATCH__Set);
-        urids.patch_property   = map_uri(this, LV2_PATCH__property);
-        urids.patch_value      = map_uri(this, LV2_PATCH__value);
-        urids.param_sampleRate = map_uri(this, LV2_PARAMETERS__sampleRate);
-    }
-
-    static LV2_URID map_uri(LV2_URID_Map_Handle h, const char* uri) {
-        auto* self = static_cast<LV2X11JackHost*>(h);
-        auto it = self->urid_map.find(uri);
-        if (it != self->urid_map.end())
-            return it->second;
-
-        LV2_URID id = self->urid_map.size() + 1;
-        self->urid_map[uri] = id;
-        self->urid_unmap[id]  = uri;
-        return id;
+    // the latency callback runs again for all clients, also while the
+    // UI loop is busy or not running
+    void start_latency_thread() {
+        sem_init(&latency_wake, 0, 0);
+        latency_running.store(true, std::memory_order_release);
+        latency_thread = std::thread([this]() {
+            while (true) {
+                sem_wait(&latency_wake);
+                if (!latency_running.load(std::memory_order_acquire)) break;
+                jack_recompute_total_latencies(jack);
+            }
+        });
     }
 
-    static const char* unmap_uri(LV2_URID_Unmap_Handle h, LV2_URID urid) {
-        auto* self = static_cast<LV2X11JackHost*>(h);
-
-        auto it = self->urid_unmap.find(urid);
-        if (it == self->urid_unmap.end())
-            return nullptr;
-
-        return it->second.c_str();
+    // after jack_deactivate(), the process callback no longer posts
+    void stop_latency_thread() {
+        if (!latency_thread.joinable()) return;
+        latency_running.store(false, std::memory_order_release);
+        sem_post(&latency_wake);
+        latency_thread.join();
+        sem_destroy(&latency_wake);
     }
 
-    std::unordered_map<std::string, LV2_URID> urid_map;
-    std::unordered_map<LV2_URID, std::string> urid_unmap;
-
-    LV2_URID_Map um;
-    LV2_URID_Unmap unm;
-
 /****************************************************************
-                        FEATURES
+        PLUGIN - instantiate the plugin and its linked copies
 
 ****************************************************************/
-    struct {
-        LV2_Feature um_f;
-        LV2_Feature unm_f;
-
-        LV2_Feature map_path_feature;
-        LV2_Feature make_path_feature;
-        LV2_Feature free_path_feature;
-        LV2_Feature bbl_feature;
-    } features;
-
-    void init_features() {
-        um.handle = this;
-        um.map = map_uri;
-        unm.handle = this;
-        unm.unmap = unmap_uri;
-
-        map_path.handle      = nullptr;
-        map_path.abstract_path = map_path_func;
-        make_path.handle = nullptr;
-        make_path.path   = make_path_func;
-        free_path.handle = nullptr;
-        free_path.free_path = free_path_func;
-        
-        features.bbl_feature.URI  = LV2_BUF_SIZE__boundedBlockLength;
-        features.bbl_feature.data = NULL;
-
-        features.um_f.URI = LV2_URID__map;
-        features.um_f.data = &um;
-
-        features.unm_f.URI = LV2_URID__unmap;
-        features.unm_f.data = &unm;
-
-        features.map_path_feature.URI = LV2_STATE__mapPath;
-        features.map_path_feature.data = &map_path;
-
-        features.make_path_feature.URI = LV2_STATE__makePath;
-        features.make_path_feature.data = &make_path;
-
-        features.free_path_feature.URI = LV2_STATE__freePath;
-        features.free_path_feature.data = &free_path;
-
-        host_worker.schedule.handle = &host_worker;
-        host_worker.schedule.schedule_work = host_schedule_work;
-        host_worker.feature.URI  = LV2_WORKER__schedule;
-        host_worker.feature.data = &host_worker.schedule;
+
+    bool init_plugin() {
+        const bool ok = openPlugin(world, plugin_uri, jack_get_sample_rate(jack), max_block_length,
+            [this](LV2Plugin& p) {
+                p.setWorkerSize(worker_size);
+                p.setDenormalProtection(denormal_protection);
+                p.setMidiEventDensity(midi_event_density);
+                p.setInstanceCount(instance_count);
+            });
+        if (!ok) fprintf(stderr, "%s could not be instantiated\n", plugin_name.data());
+        return ok;
     }
 
 /****************************************************************
-        LILV - init world and check if plugin is supported
+                PORTS - register the JACK ports
 
 ****************************************************************/
 
-    bool feature_is_supported(const char* uri, const LV2_Feature*const* f) {
-        for (; *f; ++f)
-            if (!strcmp(uri, (*f)->URI)) return true;
-        return false;
+    // copy 0 keeps the plain symbol when it runs alone
+    std::string jack_port_name(const char* symbol, uint32_t copy) const {
+        if (instance_count == 1) return symbol;
+        return std::string(symbol) + "_" + std::to_string(copy + 1);
     }
 
-    bool check_resize_port_requirements(const LilvPlugin* plugin) {
-        uint32_t n = lilv_plugin_get_num_ports(plugin);
-        LilvNode* min_size =
-            lilv_new_uri(world, LV2_RESIZE_PORT__minimumSize);
-        bool ok = true;
-
-        for (uint32_t i = 0; i < n; ++i) {
-            const LilvPort* port = lilv_plugin_get_port_by_index(plugin, i);
-            if (!lilv_port_is_a(plugin, port, atom_class)) continue;
-            LilvNodes* sizes = lilv_port_get_value(plugin, port, min_size);
-            if (!sizes || lilv_nodes_size(sizes) == 0) continue;
-            const LilvNode* n = lilv_nodes_get_first(sizes);
-            uint32_t required = lilv_node_as_int(n);
-
-            //fprintf(stderr, "Atom port %s requires minimumSize = %u\n",
-            //    lilv_node_as_string(lilv_port_get_symbol(plugin, port)),required);
-
-            if (required > required_atom_size) {
-                required_atom_size = required;
-                //ok = false; // in case we don't want support resize
-            }
-            lilv_nodes_free(sizes);
-        }
-        lilv_node_free(min_size);
-        return ok;
+    const char* port_symbol(uint32_t index, const char* fallback) const {
+        const LilvNode* sym = lilv_port_get_symbol(lilv_plugin, plugin_->getPort(index));
+        return sym ? lilv_node_as_string(sym) : fallback;
     }
 
-    bool checkFeatures(const LilvPlugin* plugin, const LV2_Feature*const* feat) {
-        LilvNodes* requests = lilv_plugin_get_required_features(plugin);
-        LILV_FOREACH(nodes, f, requests) {
-            const char* uri = lilv_node_as_uri(lilv_nodes_get(requests, f));
-            if (!feature_is_supported(uri, feat)) {
-                //fprintf(stderr, "Plugin %s \n", lilv_node_as_string(lilv_plugin_get_uri(plugin)));
-                fprintf(stderr, "Feature %s is not supported\n", uri);
-                lilv_nodes_free(requests);
-                return false;
+    // audio ports copy by copy in plugin port order, so channel j * n + k
+    // of process() is port k of copy j. MIDI goes to the first copy.
+    bool init_ports() {
+        const LV2Plugin::PortTables& t = plugin_->getPortTables();
+        for (uint32_t j = 0; j < instance_count; ++j) {
+            for (uint32_t i = 0; i < plugin_->getPortCount(); ++i) {
+                const bool in = std::find(t.audio_in.begin(), t.audio_in.end(), i) != t.audio_in.end();
+                if (!in && std::find(t.audio_out.begin(), t.audio_out.end(), i) == t.audio_out.end())
+                    continue;
+                jack_port_t* port = jack_port_register(jack,
+                    jack_port_name(port_symbol(i, "audio"), j).c_str(),
+                    JACK_DEFAULT_AUDIO_TYPE, in ? JackPortIsInput : JackPortIsOutput, 0);
+                if (!port) return false;
+                (in ? audio_in_ports : audio_out_ports).push_back(port);
             }
         }
-        lilv_nodes_free(requests);
-        return true;
-    }
-
-    bool init_lilv() {
-
-        plugin = lilv_plugins_get_by_uri(plugs, lilv_new_uri(world, plugin_uri));
-        if (!plugin) return false;
-        plugin_name = "lv2-x11-host";
-        const LilvNode* nd = nullptr;
-        nd = lilv_plugin_get_name(plugin);
-        plugin_name = lilv_node_as_string(nd);
-        //lilv_node_free(nd);
-
-        audio_class     = lilv_new_uri(world, LV2_CORE__AudioPort);
-        control_class   = lilv_new_uri(world, LV2_CORE__ControlPort);
-        atom_class      = lilv_new_uri(world, LV2_ATOM__AtomPort);
-        input_class     = lilv_new_uri(world, LV2_CORE__InputPort);
-        x11_class       = lilv_new_uri(world, LV2_UI__X11UI);
-        rsz_minimumSize = lilv_new_uri (world, LV2_RESIZE_PORT__minimumSize);
-        init_urids();
-        init_features();
-        lilv_is_inited.store(true);
-        if (!check_resize_port_requirements(plugin)) {
-            fprintf(stderr,"%s requires resize-port support – not supported\n", plugin_name.data());
-            return false;
+        for (int dir = 0; dir < 2; ++dir) {
+            const bool in = dir == 0;
+            for (uint32_t i : in ? t.midi_in : t.midi_out) {
+                MidiPort m;
+                m.index = i;
+                m.jack_port = jack_port_register(jack, port_symbol(i, "midi"),
+                    JACK_DEFAULT_MIDI_TYPE, in ? JackPortIsInput : JackPortIsOutput, 0);
+                if (!m.jack_port) return false;
+                (in ? midi_in : midi_out).push_back(m);
             }
+        }
 
+        // the ports the latency callback reads and sets: the first copy's
+        // audio and the MIDI ports come first, the latency range is read
+        // from those only
+        const uint32_t ins = plugin_->getAudioInputCount();
+        const uint32_t outs = plugin_->getAudioOutputCount();
+        input_ports.assign(audio_in_ports.begin(), audio_in_ports.begin() + ins);
+        output_ports.assign(audio_out_ports.begin(), audio_out_ports.begin() + outs);
+        for (const MidiPort& m : midi_in) input_ports.push_back(m.jack_port);
+        for (const MidiPort& m : midi_out) output_ports.push_back(m.jack_port);
+        primary_inputs = input_ports.size();
+        primary_outputs = output_ports.size();
+        input_ports.insert(input_ports.end(), audio_in_ports.begin() + ins, audio_in_ports.end());
+        output_ports.insert(output_ports.end(), audio_out_ports.begin() + outs, audio_out_ports.end());
+        jack_ports = input_ports;
+        jack_ports.insert(jack_ports.end(), output_ports.begin(), output_ports.end());
+
+        channels = std::max<uint32_t>({ 1u, (uint32_t)audio_in_ports.size(),
+                                        (uint32_t)audio_out_ports.size() });
+        if (channels > plugin_->getMaxChannels()) {
+            fprintf(stderr, "%s: %u channels, at most %u are supported\n",
+                    plugin_name.data(), channels, plugin_->getMaxChannels());
+            return false;
+        }
+        silence.assign(max_block_length, 0.0f);
+        discard.assign(max_block_length, 0.0f);
+        jack_in.assign(audio_in_ports.size(), nullptr);
+        jack_out.assign(audio_out_ports.size(), nullptr);
+        in_bufs.assign(channels, nullptr);
+        out_bufs.assign(channels, nullptr);
+        midi_out_buffers.assign(plugin_->getPortCount(), nullptr);
+
+        control_outputs.assign(t.control_out.size(), ControlOutput{});
+        const uint32_t interval = (ui_output_rate > 0.0f) ? (uint32_t)(sample_rate_ / ui_output_rate) : 0;
+        for (ControlOutput& c : control_outputs) c.interval = interval;
+        control_dirty.resize(t.control_out.size());
+
+        ui_drains.resize(t.atom_out.size());
+        for (size_t k = 0; k < t.atom_out.size(); ++k) {
+            lv2_ringbuffer_t* rb = plugin_->getAtomOutputRingbufferAt(t.atom_out[k]);
+            ui_drains[k].buf.resize(rb->size);
+            ui_drains[k].reserve(rb->size);
+        }
+        // the first latency callback reports the block latency already
+        plugin_latency.store(plugin_->getLatency(), std::memory_order_release);
         return true;
     }
 
-    void freeNodes() {
-        if (!lilv_is_inited.load()) return;
-        lilv_node_free (audio_class);
-        lilv_node_free (control_class);
-        lilv_node_free (atom_class);
-        lilv_node_free (input_class);
-        lilv_node_free (x11_class);
-        lilv_node_free (rsz_minimumSize);
-    }
-
 /****************************************************************
-        JACK - check if jack is running and open client
+            RT MEMORY - lock and prefault the buffers of the
+                        process callback before it first runs
 
 ****************************************************************/
 
-    static int jack_process(jack_nframes_t n, void* arg) {
-        return static_cast<LV2X11JackHost*>(arg)->process(n);
-    }
-
-    bool init_jack() {
-        jack = jack_client_open(plugin_name.data(), JackNullOption, nullptr);
-        if (!jack) return false;
-
-        jack_set_process_callback(jack, jack_process, this);
-        max_block_length = jack_get_buffer_size(jack);
-        return true;
+    // LV2Plugin locks its own buffers in initialize()
+    void setup_rt_memory() {
+        LV2RTMemory::lockAll();
+        bool pinned = LV2RTMemory::lock(silence.data(), silence.size() * sizeof(float));
+        pinned &= LV2RTMemory::lock(discard.data(), discard.size() * sizeof(float));
+        pinned &= LV2RTMemory::lock(jack_in.data(), jack_in.size() * sizeof(float*));
+        pinned &= LV2RTMemory::lock(jack_out.data(), jack_out.size() * sizeof(float*));
+        pinned &= LV2RTMemory::lock(in_bufs.data(), in_bufs.size() * sizeof(float*));
+        pinned &= LV2RTMemory::lock(out_bufs.data(), out_bufs.size() * sizeof(float*));
+        pinned &= LV2RTMemory::lock(midi_in.data(), midi_in.size() * sizeof(MidiPort));
+        pinned &= LV2RTMemory::lock(midi_out.data(), midi_out.size() * sizeof(MidiPort));
+        pinned &= LV2RTMemory::lock(midi_out_buffers.data(), midi_out_buffers.size() * sizeof(void*));
+        pinned &= LV2RTMemory::lock(control_outputs.data(),
+                                    control_outputs.size() * sizeof(ControlOutput));
+        if (!pinned)
+            fprintf(stderr, "Warning: RLIMIT_MEMLOCK too low, RT buffers are not locked\n");
     }
 
 /****************************************************************
-                PORTS - init plugin ports
+            PROCESS - run the plugin on the JACK period,
+                      publish its outputs to the UI
 
 ****************************************************************/
 
-    bool init_ports(bool register_jack) {
-        uint32_t n = lilv_plugin_get_num_ports(plugin);
-        ports.reserve(n);
-        LilvNode* midi_event = lilv_new_uri(world, LV2_MIDI__MidiEvent);
-
-        for (uint32_t i = 0; i < n; ++i) {
-            const LilvPort* lp = lilv_plugin_get_port_by_index(plugin, i);
-            Port p;
-            p.index = i;
-
-            p.is_audio   = lilv_port_is_a(plugin, lp, audio_class);
-            p.is_control = lilv_port_is_a(plugin, lp, control_class);
-            p.is_atom    = lilv_port_is_a(plugin, lp, atom_class);
-            p.is_input   = lilv_port_is_a(plugin, lp, input_class);
-            p.is_midi    = lilv_port_supports_event(plugin, lp, midi_event);
-
-            const LilvNode* sym = lilv_port_get_symbol(plugin, lp);
-            if (sym) {
-                p.uri = std::string(lilv_node_as_uri(lilv_plugin_get_uri(plugin)))
-                      + "#" + lilv_node_as_string(sym);
-                p.symbol = lilv_node_as_string(sym);
-                }
-
-            if (register_jack && p.is_audio) {
-                p.jack_port = jack_port_register(
-                    jack,
-                    sym ? lilv_node_as_string(sym) : "audio",
-                    JACK_DEFAULT_AUDIO_TYPE,
-                    p.is_input ? JackPortIsInput : JackPortIsOutput,
-                    0
-                );
-            }
-
-            if (register_jack && p.is_atom && p.is_input && p.is_midi) {
-                p.jack_port = jack_port_register(
-                    jack,
-                    sym ? lilv_node_as_string(sym) : "midi",
-                    JACK_DEFAULT_MIDI_TYPE,
-                    JackPortIsInput,
-                    0
-                );
-            }
-
-            if (register_jack && p.is_atom && !p.is_input && p.is_midi) {
-                p.jack_port = jack_port_register(
-                    jack,
-                    sym ? lilv_node_as_string(sym) : "midi",
-                    JACK_DEFAULT_MIDI_TYPE,
-                    JackPortIsOutput,
-                    0
-                );
-            }
-
-            if (p.is_atom) {
-                p.atom_buf_size = required_atom_size;
-
-                p.atom = (LV2_Atom_Sequence*)aligned_alloc(64, p.atom_buf_size);
-                memset(p.atom, 0, p.atom_buf_size);
-                p.atom->atom.type = urids.atom_Sequence;
-
-                if (p.is_input) {
-                    p.atom->atom.size = sizeof(LV2_Atom_Sequence_Body);
-                    p.atom->body.unit = 0;
-                    p.atom->body.pad  = 0;
-                } else {
-                    p.atom->atom.size = 0;
-                }
-
-                p.atom_state = new AtomState;
+    int process(jack_nframes_t nframes) {
+        if (shutdown.load()) return 0;
+        period = nframes;
+        // LV2Plugin splits the chunks where automation is due and runs
+        // any block length the plugin asked for
+        if (!runCycle(nframes)) {
+            for (jack_port_t* port : audio_out_ports)
+                memset(jack_port_get_buffer(port, nframes), 0, nframes * sizeof(float));
+        }
+        publish_control_outputs(nframes);
+        update_latency();
+        for (uint32_t i : plugin_->getPortTables().atom_out) {
+            if (lv2_ringbuffer_read_space(plugin_->getAtomOutputRingbufferAt(i))) {
+                wake_ui();
+                break;
             }
+        }
+        return 0;
+    }
 
-            if (p.is_control && p.is_input) {
-                LilvNode *pdflt, *pmin, *pmax;
-                lilv_port_get_range(plugin, lp, &pdflt, &pmin, &pmax);
-                if (pmin) lilv_node_free(pmin);
-                if (pmax) lilv_node_free(pmax);
-                if (pdflt) {
-                    p.defvalue = lilv_node_as_float(pdflt);
-                    lilv_node_free(pdflt);
+    // LV2PluginHost: silence and discard hold one initial period
+    uint32_t chunkFrames() const { return max_block_length; }
+
+    // RT: the JACK buffers of this chunk, channels without a port read
+    // silence and write to discard. MIDI of the chunk is staged for the
+    // plugin with its frame inside the chunk.
+    void acquire(uint32_t offset, uint32_t frames, LV2IOBlock& io) {
+        if (offset == 0) fetch_period_buffers();
+        for (uint32_t c = 0; c < channels; ++c) {
+            in_bufs[c] = c < jack_in.size() ? jack_in[c] + offset : silence.data();
+            out_bufs[c] = c < jack_out.size() ? jack_out[c] + offset : discard.data();
+        }
+        for (MidiPort& m : midi_in) {
+            for (; m.next < m.count; ++m.next) {
+                jack_midi_event_t ev;
+                if (jack_midi_event_get(&ev, m.buffer, m.next) != 0) continue;
+                if (ev.time >= offset + frames) break;
+                // program change, served off RT by the UI loop
+                if (program_change_presets && ev.size >= 2 && (ev.buffer[0] & 0xF0) == 0xC0) {
+                    requested_program.store(ev.buffer[1], std::memory_order_release);
+                    wake_ui();
                 }
+                plugin_->writeMidiInput(m.index, ev.time > offset ? ev.time - offset : 0,
+                                        ev.buffer, ev.size);
             }
-
-            ports.push_back(p);
         }
-        lilv_node_free(midi_event);
-        return true;
+        io.inputs = in_bufs.data();
+        io.outputs = out_bufs.data();
+        io.channels = channels;
     }
 
-/****************************************************************
-                DSP - init plugin instance
-
-****************************************************************/
-
-    bool init_instance() {
-        return init_instance(jack_get_sample_rate(jack));
+    // RT: the plugin's MIDI output of the chunk to the JACK ports
+    void release(uint32_t offset, uint32_t, const LV2IOBlock&) {
+        plugin_->forEachMidiOutput(
+            [this, offset](uint32_t port, uint32_t frame, const uint8_t* data, uint32_t size) {
+                return jack_midi_event_write(midi_out_buffers[port], offset + frame, data, size) == 0;
+            });
     }
 
-    bool init_instance(double sample_rate) {
-
-        LV2_Options_Option options[] = {
-            {
-                LV2_OPTIONS_INSTANCE,
-                0,
-                urids.buf_maxBlock,
-                sizeof(uint32_t),
-                urids.atom_Int,
-                &max_block_length
-            },
-            { LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr }
-        };
-
-        LV2_Feature opt_f { LV2_OPTIONS__options, options };
-
-        LV2_Feature* feats[] = { &features.um_f, &features.unm_f, &opt_f,
-                            &features.bbl_feature, &host_worker.feature, nullptr };
-
-        if (!checkFeatures(plugin, feats)) return false;
-
-        // instantiate the plugin dsp instance 
-        instance = lilv_plugin_instantiate(plugin, sample_rate, feats);
-
-        if (!instance) return false;
-
-        // check if plugin require a worker thread 
-        const LV2_Worker_Interface* iface = (const LV2_Worker_Interface*)
-            lilv_instance_get_extension_data( instance, LV2_WORKER__interface);
-
-        // start worker when plugin wants it
-        if (iface) {
-            host_worker.iface = iface;
-            host_worker.dsp_handle = lilv_instance_get_handle(instance);
-            host_worker.requests  = lv2_ringbuffer_create(8192);
-            host_worker.responses = lv2_ringbuffer_create(8192);
-            host_worker.response_buffer.resize(8192);
-            host_worker.running.store(true);
-            host_worker.worker_thread =
-                std::thread(worker_thread_func, &host_worker);
+    // RT: the period's buffers, once per cycle. MIDI outputs are cleared
+    // here, every chunk appends to them.
+    void fetch_period_buffers() {
+        for (size_t c = 0; c < audio_in_ports.size(); ++c)
+            jack_in[c] = (float*)jack_port_get_buffer(audio_in_ports[c], period);
+        for (size_t c = 0; c < audio_out_ports.size(); ++c)
+            jack_out[c] = (float*)jack_port_get_buffer(audio_out_ports[c], period);
+        for (MidiPort& m : midi_in) {
+            m.buffer = jack_port_get_buffer(m.jack_port, period);
+            m.count = jack_midi_get_event_count(m.buffer);
+            m.next = 0;
         }
-
-        // connect control and atom ports
-        for (auto& p : ports) {
-            if (p.is_audio) continue;
-            if (p.is_control)
-                lilv_instance_connect_port(instance, p.index, &p.control);
-            if (p.is_atom)
-                lilv_instance_connect_port(instance, p.index, p.atom);
+        for (MidiPort& m : midi_out) {
+            m.buffer = jack_port_get_buffer(m.jack_port, period);
+            jack_midi_clear_buffer(m.buffer);
+            midi_out_buffers[m.index] = m.buffer;
         }
-        lilv_instance_activate(instance);
-        return true;
     }
 
-/****************************************************************
-            PROCESS - run the audio/midi process
-                      deliver and read atom ports
-
-****************************************************************/
-
-    int process(jack_nframes_t nframes) {
-        if (shutdown.load()) return 0;
-        for (Port& p : ports) {
-            // connect all audio ports
-            if (p.is_audio) {
-                void* buf = jack_port_get_buffer(p.jack_port, nframes);
-                lilv_instance_connect_port(instance, p.index, buf);
-            }
-            // prepare atom output buffers for plugin write  
-            if (p.is_atom && !p.is_input) {
-                p.atom->atom.type = 0;
-                p.atom->atom.size = p.atom_buf_size - sizeof(LV2_Atom);
-            }
-            // handle atom input ports
-            if (p.is_atom && p.is_input) {
-                // handle midi input
-                if (p.is_midi) {
-                    void* midi_buf = jack_port_get_buffer(p.jack_port, nframes);
-                    uint32_t event_count = jack_midi_get_event_count(midi_buf);
-                    lv2_atom_sequence_clear(p.atom);
-                    p.atom->atom.type = urids.atom_Sequence;
-                    p.atom->atom.size = sizeof(LV2_Atom_Sequence_Body);
-                    for (uint32_t i = 0; i < event_count; ++i) {
-                        jack_midi_event_t ev;
-                        jack_midi_event_get(&ev, midi_buf, i);
-                        uint8_t evbuf[sizeof(LV2_Atom_Event) + required_atom_size];
-                        LV2_Atom_Event* aev = (LV2_Atom_Event*)evbuf;
-                        aev->time.frames = ev.time;
-                        aev->body.type  = urids.midi_Event;
-                        aev->body.size  = ev.size;
-                        memcpy(LV2_ATOM_BODY(&aev->body), ev.buffer, ev.size);
-                        lv2_atom_sequence_append_event(p.atom, p.atom_buf_size, aev);
-                    }
-                }
-                // handle atom messages from GUI to dsp
-                if (p.atom_state->ui_to_dsp_pending.exchange(false)) {
-                    p.atom->atom.type = urids.atom_Sequence;
-                    p.atom->atom.size = 0;
-                    const uint32_t body_size = p.atom_state->ui_to_dsp.size();
-                    uint8_t evbuf[sizeof(LV2_Atom_Event) + required_atom_size];
-                    LV2_Atom_Event* ev = (LV2_Atom_Event*)evbuf;
-                    ev->time.frames = 0;
-                    ev->body.type  = p.atom_state->ui_to_dsp_type;
-                    ev->body.size  = body_size;
-                    memcpy((uint8_t*)LV2_ATOM_BODY(&ev->body),
-                        p.atom_state->ui_to_dsp.data(), body_size);
-                    lv2_atom_sequence_append_event( p.atom, p.atom_buf_size, ev);
-                }
+    // RT: flag the control outputs that changed, at most once per
+    // interval each
+    void publish_control_outputs(uint32_t nframes) {
+        const auto& out = plugin_->getPortTables().control_out;
+        bool changed = false;
+        for (uint32_t k = 0; k < out.size(); ++k) {
+            ControlOutput& c = control_outputs[k];
+            if (c.holdoff > nframes) {
+                c.holdoff -= nframes;
+                continue;
             }
+            c.holdoff = 0;
+            const float value = plugin_->getControlValueAt(out[k]);
+            if (value == c.sent) continue;
+            c.sent = value;
+            c.holdoff = c.interval;
+            control_dirty.set(k);
+            changed = true;
         }
-        // run the plugin
-        lilv_instance_run(instance, nframes);
-        // deliver worker response (work done)
-        if (host_worker.iface ) deliver_worker_responses(&host_worker);
-        // handle atom output ports (dsp to GUI)
-        for (Port& p : ports) {
-            // send control output port values to the UI
-            if (p.is_control && !p.is_input) ui_dirty.store(true);
-            // reset atom input port buffer after dsp have read it
-            if (p.is_atom && p.is_input) p.atom->atom.size = 0;
-            // init a midi output buffer when needed
-            void* midi_buf = nullptr;
-            if (p.is_atom && !p.is_input && p.is_midi) {
-                midi_buf = jack_port_get_buffer(p.jack_port, nframes);
-                jack_midi_clear_buffer(midi_buf);
-            }
-            // handle atom messages from dsp to UI (using a ringbuffer)
-            if (p.is_atom && !p.is_input) {
-                LV2_Atom_Sequence* seq = p.atom;
-                LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
-                    if (ev->body.size == 0)break;
-                    if (p.atom->atom.type == 0) break;
-                    const uint32_t total = sizeof(LV2_Atom) + ev->body.size;
-                    if (lv2_ringbuffer_write_space(p.atom_state->dsp_to_ui) >= total) {
-                        lv2_ringbuffer_write(p.atom_state->dsp_to_ui, (const char*)&ev->body, total);
-                    }
-                    // forward midi output to jack
-                    if (ev->body.type == urids.midi_Event) {
-                        const uint8_t* midi = (const uint8_t*)LV2_ATOM_BODY(&ev->body);
-                        const uint32_t size = ev->body.size;
-                        const uint32_t frame = ev->time.frames;
-                        jack_midi_event_write(midi_buf, frame, midi, size);
-                    }
-                }
-                p.atom->atom.type = 0;
-                p.atom->atom.size = required_atom_size;
-            }
+        if (changed) {
+            ui_dirty.store(true, std::memory_order_release);
+            wake_ui();
         }
-        return 0;
+    }
+
+    // RT: a new latency has the latency thread ask JACK to recompute the
+    // graph latencies, that must not happen on this thread. sem_post() is
+    // RT safe.
+    void update_latency() {
+        const uint32_t frames = plugin_->getLatency();
+        if (frames == plugin_latency.load(std::memory_order_relaxed)) return;
+        plugin_latency.store(frames, std::memory_order_release);
+        sem_post(&latency_wake);
+    }
+
+    // RT: signal the UI loop, once until it re-arms. A non-blocking
+    // eventfd write, at most ui_dsp_rate times per second.
+    void wake_ui() {
+        if (ui_wake_armed.load(std::memory_order_relaxed) &&
+            ui_wake_armed.exchange(false, std::memory_order_acq_rel))
+            eventfd_write(ui_wake_fd, 1);
     }
 
 /****************************************************************
@@ -1137,26 +1071,36 @@ private:
                 uint32_t size, uint32_t type, const void* buf) {
 
         auto* self = static_cast<LV2X11JackHost*>(c);
-        auto& p = self->ports[port];
+        LV2Plugin& plugin = *self->plugin_;
 
-        if (p.is_control && size == sizeof(float)) {
-            p.control = *(const float*)buf;
+        const LV2Plugin::ControlHandle h = plugin.getControlHandleAt(port);
+        if (h.valid()) {
+            // in order with the plugin's other automation, written
+            // directly only when the queue is full
+            if (size == sizeof(float)) plugin.queueValue(h, *(const float*)buf);
             return;
         }
 
-        if (p.is_atom) {
-            p.atom_state->ui_to_dsp.resize(size);
-            memcpy(p.atom_state->ui_to_dsp.data(), buf, size);
-            p.atom_state->ui_to_dsp_type = type;
-            p.atom_state->ui_to_dsp_pending.store(true, std::memory_order_release);
+        // atom:eventTransfer hands over a complete atom, anything but an
+        // atom input is refused by the plugin
+        if (type == self->atom_eventTransfer) {
+            if (size < sizeof(LV2_Atom)) return;
+            const LV2_Atom* atom = (const LV2_Atom*)buf;
+            plugin.writeAtomMessageAt(port, atom->type, atom->size, atom + 1);
+        } else {
+            plugin.writeAtomMessageAt(port, type, size, buf);
         }
     }
 
-    static uint32_t ui_port_map(LV2UI_Feature_Handle h, const char* uri) {
+    // ui:portMap passes port symbols, full port URIs are accepted as well
+    static uint32_t ui_port_map(LV2UI_Feature_Handle h, const char* symbol) {
         auto* self = static_cast<LV2X11JackHost*>(h);
-        for (auto& p : self->ports)
-            if (p.uri == uri) return p.index;
-        return LV2UI_INVALID_PORT_INDEX;
+        const uint32_t i = self->find_port(symbol);
+        if (i != LV2UI_INVALID_PORT_INDEX || !symbol) return i;
+        const size_t n = strlen(self->plugin_uri);
+        if (strncmp(symbol, self->plugin_uri, n) || symbol[n] != '#')
+            return LV2UI_INVALID_PORT_INDEX;
+        return self->find_port(symbol + n + 1);
     }
 
     static int ui_resize(LV2UI_Feature_Handle h, int w, int hgt) {
@@ -1172,28 +1116,72 @@ private:
     }
 
     void send_initial_ui_values() {
-        for (auto& p : ports)
-            if (p.is_control && p.is_input) {
-                p.control = p.defvalue;
-                ui_desc->port_event(
-                    ui_handle, p.index, sizeof(float), 0, &p.defvalue);
-            }
+        for (uint32_t i : plugin_->getPortTables().control_in) {
+            float value = plugin_->getControlRangeAt(i)->defvalue;
+            plugin_->setValue(plugin_->getControlHandleAt(i), value);
+            ui_desc->port_event(
+                ui_handle, i, sizeof(float), 0, &value);
+        }
     }
 
     void send_control_values() {
-        for (auto& p : ports)
-            if (p.is_control && p.is_input) {
-                ui_desc->port_event(
-                    ui_handle, p.index, sizeof(float), 0, &p.control);
-            }
+        for (uint32_t i : plugin_->getPortTables().control_in) {
+            float value = plugin_->getControlValueAt(i);
+            ui_desc->port_event(
+                ui_handle, i, sizeof(float), 0, &value);
+        }
     }
 
+    // only the control outputs flagged by publish_control_outputs()
     void send_control_outputs() {
-        for (auto& p : ports)
-            if (p.is_control && !p.is_input) {
+        const auto& out = plugin_->getPortTables().control_out;
+        for (size_t w = 0; w < control_dirty.count; ++w) {
+            uint64_t bits = control_dirty.take(w);
+            while (bits) {
+                const uint32_t k = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                float value = plugin_->getControlValueAt(out[k]);
                 ui_desc->port_event(
-                    ui_handle, p.index, sizeof(float), 0, &p.control);
+                    ui_handle, out[k], sizeof(float), 0, &value);
+            }
+        }
+    }
+
+    // forward everything the plugin sent since the last frame. Older
+    // patch:Set messages for a property overwritten within the same frame
+    // are stale and skipped, everything else arrives in order.
+    void forward_atoms_to_ui(uint32_t k) {
+        const uint32_t index = plugin_->getPortTables().atom_out[k];
+        UIDrain& d = ui_drains[k];
+        lv2_ringbuffer_t* rb = plugin_->getAtomOutputRingbufferAt(index);
+
+        // messages are published whole, so the read space ends on a frame
+        const size_t avail = lv2_ringbuffer_read_space(rb);
+        if (!avail) return;
+        lv2_ringbuffer_peek(rb, (char*)d.buf.data(), avail);
+        lv2_ringbuffer_read_advance(rb, avail);
+
+        d.next_frame();
+        for (size_t off = 0; off + sizeof(LV2_Atom) <= avail;) {
+            const LV2_Atom* atom = (const LV2_Atom*)(d.buf.data() + off);
+            const uint64_t key = plugin_->patchSetKey(atom);
+            if (key) {
+                UIDrain::Latest& l = d.find(key);
+                l.key = key;
+                l.stamp = d.stamp;
+                l.msg = d.msgs.size();
             }
+            d.msgs.push_back({ (uint32_t)off, key });
+            off += lv2_ringbuffer_msg_pad(sizeof(LV2_Atom) + atom->size);
+        }
+
+        for (uint32_t m = 0; m < d.msgs.size(); ++m) {
+            const uint64_t key = d.msgs[m].key;
+            if (key && d.find(key).msg != m) continue;
+            const LV2_Atom* atom = (const LV2_Atom*)(d.buf.data() + d.msgs[m].offset);
+            ui_desc->port_event(ui_handle, index, sizeof(LV2_Atom) + atom->size,
+                                atom_eventTransfer, atom);
+        }
     }
 
     void destroy_ui() {
@@ -1209,7 +1197,7 @@ private:
 ****************************************************************/
 
     bool init_ui() {
-        const LilvUIs* uis = lilv_plugin_get_uis(plugin);
+        const LilvUIs* uis = lilv_plugin_get_uis(lilv_plugin);
         const LilvUI* ui = nullptr;
 
         char* gui_uri = nullptr;
@@ -1259,14 +1247,15 @@ private:
         XFlush(x_display);
 
         float ui_sample_rate = (float)jack_get_sample_rate(jack);
+        atom_eventTransfer = um.map(um.handle, LV2_ATOM__eventTransfer);
 
         LV2_Options_Option ui_options[] = {
             {
                 LV2_OPTIONS_INSTANCE,
                 0,
-                urids.param_sampleRate,
+                um.map(um.handle, LV2_PARAMETERS__sampleRate),
                 sizeof(float),
-                urids.atom_Float,
+                um.map(um.handle, LV2_ATOM__Float),
                 &ui_sample_rate
             },
             { LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr }
@@ -1283,8 +1272,11 @@ private:
         LV2_Feature parent { LV2_UI__parent, (void*)x_window };
         LV2_Feature resize_f { LV2_UI__resize, &resize };
 
+        LV2_Feature um_f { LV2_URID__map, &um };
+        LV2_Feature unm_f { LV2_URID__unmap, &unm };
+
         LV2_Feature* feats[] = { &parent, &resize_f, &pm_f, &ui_options_feature,
-                                &features.um_f, &features.unm_f, nullptr };
+                                &um_f, &unm_f, nullptr };
 
         ui_handle = ui_desc->instantiate( ui_desc, plugin_uri, bundle,
                                           ui_write, this, &ui_widget, feats);
@@ -1318,14 +1310,36 @@ private:
 
     LilvWorld* world = nullptr;
     const LilvPlugins* plugs =  nullptr;
-    const LilvPlugin* plugin = nullptr;
-    LilvInstance* instance = nullptr;
+    const LilvPlugin* lilv_plugin = nullptr;
+    LilvNode* x11_class = nullptr;
 
-    LilvNode *audio_class, *control_class, *atom_class,
-             *input_class, *x11_class,*rsz_minimumSize;
+    // the UI and the preset parser share the plugin's URID map
+    LV2_URID_Map um;
+    LV2_URID_Unmap unm;
+    LV2_URID atom_eventTransfer = 0;
 
     jack_client_t* jack = nullptr;
-    std::vector<Port> ports;
+    std::vector<jack_port_t*> audio_in_ports;   // [copy][audio input]
+    std::vector<jack_port_t*> audio_out_ports;  // [copy][audio output]
+    std::vector<MidiPort> midi_in;
+    std::vector<MidiPort> midi_out;
+    std::vector<jack_port_t*> input_ports;      // audio and MIDI, for the latency callback
+    std::vector<jack_port_t*> output_ports;
+    size_t primary_inputs = 0;                  // of those the first copy's and MIDI
+    size_t primary_outputs = 0;
+    std::vector<jack_port_t*> jack_ports;       // every registered port
+    jack_nframes_t period = 0;                  // frames of the running cycle
+
+    // RT: the planar view process() gets, channels without a JACK port
+    // read silence and write to discard
+    uint32_t channels = 1;
+    std::vector<float*> jack_in;
+    std::vector<float*> jack_out;
+    std::vector<float*> in_bufs;
+    std::vector<float*> out_bufs;
+    std::vector<float> silence;
+    std::vector<float> discard;
+    std::vector<void*> midi_out_buffers;        // by plugin port index
 
     LV2UI_Resize resize;
     void* ui_dl = nullptr;
@@ -1339,155 +1353,38 @@ private:
     int wy = 480;
 
     uint32_t max_block_length = 4096;
-    uint32_t required_atom_size = 8192;
+    float midi_event_density = 1.0f;
+    uint32_t worker_size = 8192;
+    bool denormal_protection = true;
+
+    LV2PluginCache plugin_cache;
+    bool use_cache = true;
+    bool cache_refreshed = false;
+
+    std::vector<PresetInfo> preset_index;
+    std::unordered_map<std::string, LilvState*> preset_states;
+    std::atomic<int> requested_program{-1};
+    bool program_change_presets = true;
+    bool dsp_active = false;
 
-    std::atomic<bool> lilv_is_inited{false};
     std::atomic<bool> ui_dirty{false};
+    int ui_wake_fd = -1;                        // eventfd, process -> UI loop
+    std::atomic<bool> ui_wake_armed{false};
+    float ui_idle_rate = 60.0f;
+    float ui_hidden_rate = 4.0f;
+    float ui_dsp_rate = 120.0f;                 // max DSP driven wakeups per second
+    std::vector<ControlOutput> control_outputs; // [port_tables.control_out]
+    DirtyBits control_dirty;
+    std::vector<UIDrain> ui_drains;             // [port_tables.atom_out]
+    float ui_output_rate = 0.0f;
     std::atomic<bool> ui_needs_initial_update{false};
     std::atomic<bool> ui_needs_control_update{false};
     std::atomic<bool> run{false};
     std::atomic<bool> shutdown{false};
-};
-
-#ifdef __ANDROID__
-class LV2OboeHost : public LV2X11JackHost, public oboe::AudioStreamDataCallback {
-public:
-    ~LV2OboeHost() {
-        stop_audio();
-        if (audio_stream) audio_stream->close();
-    }
-
-    bool init_oboe(const char* uri, int32_t sample_rate, int32_t frames_per_burst) {
-        if (!init_no_jack(uri, sample_rate, static_cast<uint32_t>(frames_per_burst)))
-            return false;
-        return init_audio(sample_rate, frames_per_burst);
-    }
-
-    bool init_audio(int32_t sample_rate, int32_t frames_per_burst) {
-        oboe::AudioStreamBuilder builder;
-        oboe::Result result = builder
-            .setDirection(oboe::Direction::Output)
-            .setPerformanceMode(oboe::PerformanceMode::LowLatency)
-            .setSharingMode(oboe::SharingMode::Exclusive)
-            .setFormat(oboe::AudioFormat::Float)
-            .setChannelCount(2)
-            .setSampleRate(sample_rate)
-            .setFramesPerCallback(frames_per_burst)
-            .setDataCallback(this)
-            .openStream(audio_stream);
-
-        if (result != oboe::Result::OK) return false;
-
-        channel_capacity = frames_per_burst;
-        left_channel.reset(new float[channel_capacity]);
-        right_channel.reset(new float[channel_capacity]);
-        std::fill(left_channel.get(), left_channel.get() + channel_capacity, 0.0f);
-        std::fill(right_channel.get(), right_channel.get() + channel_capacity, 0.0f);
-        return true;
-    }
-
-    void start_audio() {
-        if (audio_stream) audio_stream->start();
-    }
-
-    void stop_audio() {
-        if (audio_stream) audio_stream->stop();
-    }
-
-    oboe::DataCallbackResult onAudioReady(
-        oboe::AudioStream* /*stream*/,
-        void* audioData,
-        int32_t numFrames) override {
-
-        if (shutdown.load(std::memory_order_acquire))
-            return oboe::DataCallbackResult::Stop;
-
-        if (!audioData || numFrames <= 0 || numFrames > channel_capacity)
-            return oboe::DataCallbackResult::Stop;
-
-        auto* buffer = static_cast<float*>(audioData);
-
-        for (int32_t i = 0; i < numFrames; ++i) {
-            left_channel[i] = buffer[i * 2];
-            right_channel[i] = buffer[i * 2 + 1];
-        }
+    std::atomic<uint32_t> plugin_latency{0};
+    std::atomic<bool> latency_running{false};
+    sem_t latency_wake;
+    std::thread latency_thread;
 
-        uint32_t input_index = 0;
-        uint32_t output_index = 0;
-        for (auto& p : ports) {
-            if (!p.is_audio) continue;
-
-            float* target = left_channel.get();
-            if (p.is_input) {
-                target = (input_index == 0) ? left_channel.get() : right_channel.get();
-                ++input_index;
-            } else {
-                target = (output_index == 0) ? left_channel.get() : right_channel.get();
-                ++output_index;
-            }
-
-            lilv_instance_connect_port(instance, p.index, target);
-        }
-
-        for (auto& p : ports) {
-            if (p.is_atom && !p.is_input) {
-                p.atom->atom.type = 0;
-                p.atom->atom.size = p.atom_buf_size - sizeof(LV2_Atom);
-            }
-
-            if (p.is_atom && p.is_input) {
-                if (p.atom_state->ui_to_dsp_pending.exchange(false, std::memory_order_acquire)) {
-                    p.atom->atom.type = urids.atom_Sequence;
-                    p.atom->atom.size = 0;
-                    const uint32_t body_size = p.atom_state->ui_to_dsp.size();
-                    uint8_t evbuf[sizeof(LV2_Atom_Event) + required_atom_size];
-                    LV2_Atom_Event* ev = (LV2_Atom_Event*)evbuf;
-                    ev->time.frames = 0;
-                    ev->body.type  = p.atom_state->ui_to_dsp_type;
-                    ev->body.size  = body_size;
-                    memcpy((uint8_t*)LV2_ATOM_BODY(&ev->body),
-                        p.atom_state->ui_to_dsp.data(), body_size);
-                    lv2_atom_sequence_append_event(p.atom, p.atom_buf_size, ev);
-                }
-            }
-        }
-
-        lilv_instance_run(instance, numFrames);
-
-        if (host_worker.iface) deliver_worker_responses(&host_worker);
-
-        for (auto& p : ports) {
-            if (p.is_control && !p.is_input) ui_dirty.store(true, std::memory_order_release);
-            if (p.is_atom && p.is_input) p.atom->atom.size = 0;
-            if (p.is_atom && !p.is_input) {
-                LV2_Atom_Sequence* seq = p.atom;
-                LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
-                    if (ev->body.size == 0) break;
-                    if (p.atom->atom.type == 0) break;
-                    const uint32_t total = sizeof(LV2_Atom) + ev->body.size;
-                    if (lv2_ringbuffer_write_space(p.atom_state->dsp_to_ui) >= total) {
-                        lv2_ringbuffer_write(p.atom_state->dsp_to_ui,
-                            (const char*)&ev->body, total);
-                    }
-                }
-                p.atom->atom.type = 0;
-                p.atom->atom.size = required_atom_size;
-            }
-        }
-
-        for (int32_t i = 0; i < numFrames; ++i) {
-            buffer[i * 2] = left_channel[i];
-            buffer[i * 2 + 1] = right_channel[i];
-        }
-
-        return oboe::DataCallbackResult::Continue;
-    }
-
-private:
-    std::shared_ptr<oboe::AudioStream> audio_stream;
-    std::unique_ptr<float[]> left_channel;
-    std::unique_ptr<float[]> right_channel;
-    int32_t channel_capacity = 0;
+    uint32_t instance_count = 1;                // set_instance_count()
 };
-#endif
-
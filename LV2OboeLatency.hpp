@@ -0,0 +1,147 @@
+/*
+ * LV2OboeLatency.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Adaptive buffer size for an Oboe output stream.
+ *
+ * A non-RT thread polls getXRunCount(). Every new underrun grows the buffer by
+ * one burst, up to the stream capacity. After a quiet period it tries one
+ * burst less again; when that size underruns too, the quiet period doubles,
+ * so the controller settles on the smallest glitch-free size for the device
+ * instead of oscillating around it.
+ */
+
+#pragma once
+
+#include <oboe/Oboe.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct OboeLatencyStats {
+    int32_t burst_frames = 0;
+    int32_t buffer_frames = 0;
+    int32_t capacity_frames = 0;
+    int32_t xruns = 0;
+    double latency_ms = -1.0;   // -1 when the device can't tell
+    bool exclusive = false;
+    bool low_latency = false;
+};
+
+class OboeLatencyTuner {
+public:
+    std::chrono::milliseconds poll_interval{100};
+    std::chrono::milliseconds quiet_before_shrink{5000};
+    std::chrono::milliseconds max_quiet{120000};
+
+    ~OboeLatencyTuner() {
+        stop();
+    }
+
+    // starts at two bursts, the usual glitch free minimum. Without xrun
+    // counting only the starting size is applied.
+    void start(std::shared_ptr<oboe::AudioStream> stream) {
+        stop();
+        stream_ = std::move(stream);
+        if (!stream_) return;
+
+        burst_ = std::max(1, stream_->getFramesPerBurst());
+        capacity_ = stream_->getBufferCapacityInFrames();
+        apply(2 * burst_);
+        exclusive_.store(stream_->getSharingMode() == oboe::SharingMode::Exclusive);
+        low_latency_.store(stream_->getPerformanceMode() == oboe::PerformanceMode::LowLatency);
+        update();
+
+        if (!stream_->isXRunCountSupported()) return;
+        running_ = true;
+        thread_ = std::thread(&OboeLatencyTuner::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        stream_.reset();
+    }
+
+    // any thread
+    OboeLatencyStats stats() const {
+        OboeLatencyStats s;
+        s.burst_frames = burst_;
+        s.capacity_frames = capacity_;
+        s.buffer_frames = buffer_frames_.load(std::memory_order_relaxed);
+        s.xruns = xruns_.load(std::memory_order_relaxed);
+        s.latency_ms = latency_ms_.load(std::memory_order_relaxed);
+        s.exclusive = exclusive_.load(std::memory_order_relaxed);
+        s.low_latency = low_latency_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    void run() {
+        int32_t last_xruns = xruns_.load();
+        int32_t failed_size = 0;    // smallest size seen underrunning
+        auto quiet = quiet_before_shrink;
+        auto quiet_since = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            wake_.wait_for(lock, poll_interval);
+            if (!running_) break;
+            update();
+
+            const int32_t xruns = xruns_.load();
+            const int32_t size = buffer_frames_.load();
+            const auto now = std::chrono::steady_clock::now();
+
+            if (xruns > last_xruns) {
+                last_xruns = xruns;
+                // underrun again right after a shrink: wait longer next time
+                if (failed_size && size <= failed_size) quiet = std::min(quiet * 2, max_quiet);
+                failed_size = size;
+                if (size < capacity_) apply(std::min(size + burst_, capacity_));
+                quiet_since = now;
+            } else if (now - quiet_since >= quiet && size > burst_) {
+                apply(size - burst_);
+                quiet_since = now;
+            }
+        }
+    }
+
+    void apply(int32_t frames) {
+        auto r = stream_->setBufferSizeInFrames(frames);
+        buffer_frames_.store(r ? r.value() : stream_->getBufferSizeInFrames());
+    }
+
+    void update() {
+        auto x = stream_->getXRunCount();
+        if (x) xruns_.store(x.value(), std::memory_order_relaxed);
+        auto l = stream_->calculateLatencyMillis();
+        latency_ms_.store(l ? l.value() : -1.0, std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<oboe::AudioStream> stream_;
+    int32_t burst_ = 0;
+    int32_t capacity_ = 0;
+
+    std::atomic<int32_t> buffer_frames_{0};
+    std::atomic<int32_t> xruns_{0};
+    std::atomic<double> latency_ms_{-1.0};
+    std::atomic<bool> exclusive_{false};
+    std::atomic<bool> low_latency_{false};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+    std::thread thread_;
+};
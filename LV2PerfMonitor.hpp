@@ -0,0 +1,431 @@
+/*
+ * LV2PerfMonitor.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Cycle timing and DSP load - Backend Agnostic
+ *
+ * The audio thread timestamps every process cycle with the monotonic clock
+ * and pushes one fixed size LV2CycleRecord into a SPSC ring, nothing else
+ * happens on the RT side. A non-RT thread drains the ring, folds the records
+ * into a log2 histogram of the DSP load (callback time / period budget) and
+ * publishes an LV2PerfReport once per interval: to a callback, and optionally
+ * to a POSIX shared memory segment other processes can map read-only.
+ *
+ * Disabled monitors cost one branch per cycle, the ring is only allocated
+ * when enable() is called.
+ */
+
+#pragma once
+
+#include "lv2_ringbuffer.h"
+#include "LV2RTMemory.hpp"
+
+#include <time.h>
+
+#if !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+// ============================================================================
+// LV2CycleRecord - one process cycle, written by the audio thread
+// ============================================================================
+
+struct LV2CycleRecord {
+    static constexpr uint32_t kDenormal = 1;    // run() raised denormal flags
+    static constexpr uint32_t kIdle = 2;        // the idle gate skipped run()
+
+    uint64_t start_ns = 0;          // CLOCK_MONOTONIC at callback entry
+    uint32_t cycle_ns = 0;          // whole callback
+    uint32_t run_ns = 0;            // lilv_instance_run() alone
+    uint32_t budget_ns = 0;         // frames / sample rate
+    uint32_t frames = 0;
+    uint32_t atom_in_bytes = 0;     // sequence bodies handed to the plugin
+    uint32_t atom_out_bytes = 0;    // sequence bodies the plugin wrote
+    uint32_t worker_msgs = 0;       // worker responses delivered
+    uint32_t flags = 0;
+};
+
+// ============================================================================
+// LV2PerfReport - aggregated view, produced off RT
+// ============================================================================
+
+struct LV2PerfReport {
+    uint64_t cycles = 0;            // records aggregated since start/reset
+    uint64_t xruns = 0;
+    uint64_t dropped = 0;           // records lost, ring full
+
+    // DSP load as a fraction of the period budget, 1.0 = the whole period
+    double load_p50 = 0.0;
+    double load_p99 = 0.0;
+    double load_max = 0.0;
+
+    double run_mean_us = 0.0;
+    double run_max_us = 0.0;
+    double cycle_max_us = 0.0;
+    double budget_us = 0.0;         // of the last cycle
+
+    // cycles whose run() raised denormal flags, and those of them which
+    // also took more than twice the median load
+    uint64_t denormal_cycles = 0;
+    uint64_t denormal_spikes = 0;
+
+    // cycles the idle gate skipped, and the DSP load that saved as a
+    // fraction of the budget: skipped cycles at the mean run() time of
+    // the others
+    uint64_t idle_cycles = 0;
+    double idle_saved = 0.0;
+
+    // per second, over the last interval
+    double atom_in_bps = 0.0;
+    double atom_out_bps = 0.0;
+    double worker_msgs_ps = 0.0;
+};
+
+// ============================================================================
+// LV2LoadHistogram - log2 buckets, four linear steps per octave
+// ============================================================================
+
+// Values are the load in parts per million of the budget. Quarter octaves keep
+// the percentile error below 25% over the full range with 124 counters.
+class LV2LoadHistogram {
+public:
+    static constexpr uint32_t kSub = 4;
+    static constexpr uint32_t kBuckets = 31 * kSub;
+
+    static uint32_t index(uint32_t v) {
+        if (v < kSub) return v;
+        const uint32_t msb = 31 - __builtin_clz(v);
+        return (msb - 1) * kSub + ((v >> (msb - 2)) & (kSub - 1));
+    }
+
+    static uint64_t lower(uint32_t idx) {
+        if (idx < kSub) return idx;
+        return (uint64_t)(kSub + idx % kSub) << (idx / kSub - 1);
+    }
+
+    // exclusive upper bound
+    static uint64_t upper(uint32_t idx) { return lower(idx + 1); }
+
+    void add(uint32_t v) {
+        ++counts_[index(v)];
+        ++total_;
+        max_ = std::max(max_, v);
+    }
+
+    // smallest bucket bound at or above the q quantile, q in [0, 1]
+    uint32_t percentile(double q) const {
+        if (!total_) return 0;
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * total_ + 0.5));
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return (uint32_t)std::min<uint64_t>(upper(i) - 1, max_);
+        }
+        return max_;
+    }
+
+    uint64_t count(uint32_t idx) const { return counts_[idx]; }
+    uint64_t total() const { return total_; }
+    uint32_t max() const { return max_; }
+
+    void clear() { *this = LV2LoadHistogram(); }
+
+private:
+    uint64_t counts_[kBuckets] = {};
+    uint64_t total_ = 0;
+    uint32_t max_ = 0;
+};
+
+// ============================================================================
+// LV2PerfShared - layout of the shared memory export
+// ============================================================================
+
+// Seqlock: the writer makes seq odd while it updates report, readers retry
+// when seq is odd or changed between their two loads.
+struct LV2PerfShared {
+    static constexpr uint32_t kMagic = 0x4c505246;     // "LPRF"
+    static constexpr uint32_t kVersion = 2;
+
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> seq;
+    uint32_t reserved;
+    LV2PerfReport report;
+    uint64_t histogram[LV2LoadHistogram::kBuckets];
+};
+
+// ============================================================================
+// LV2PerfMonitor - RT record ring plus the aggregator thread
+// ============================================================================
+
+class LV2PerfMonitor {
+public:
+    std::chrono::milliseconds drain_interval{50};
+    std::chrono::milliseconds report_interval{1000};
+
+    ~LV2PerfMonitor() {
+        stop();
+        if (ring_) lv2_ringbuffer_free(ring_);
+        unmap_shared();
+    }
+
+    // RT safe (vDSO), nanoseconds of CLOCK_MONOTONIC
+    static uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    }
+
+    // before the audio callback runs, size in records
+    void enable(uint32_t records = 4096) {
+        if (ring_) return;
+        ring_ = lv2_ringbuffer_create(next_power_of_two(records * sizeof(LV2CycleRecord)));
+        LV2RTMemory::lock(ring_);
+        enabled_ = ring_ != nullptr;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // RT
+    void record(const LV2CycleRecord& r) {
+        if (lv2_ringbuffer_write_space(ring_) < sizeof(LV2CycleRecord)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        lv2_ringbuffer_write(ring_, (const char*)&r, sizeof(LV2CycleRecord));
+    }
+
+    // any thread, the JACK xrun callback
+    void xrun() { xruns_.fetch_add(1, std::memory_order_relaxed); }
+
+    // polled by the aggregator for backends without an xrun callback,
+    // returns the backend's running total
+    void setXrunSource(std::function<uint64_t()> source) { xrun_source_ = std::move(source); }
+
+    // called from the aggregator thread once per report_interval
+    void onReport(std::function<void(const LV2PerfReport&)> cb) { on_report_ = std::move(cb); }
+
+    // export every report to shm_open(name), e.g. "/luma-perf". Before start().
+    bool exportShared(const std::string& name) {
+#if !defined(__ANDROID__)
+        unmap_shared();
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, sizeof(LV2PerfShared)) != 0) {
+            close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        void* p = mmap(nullptr, sizeof(LV2PerfShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            return false;
+        }
+        shared_ = new (p) LV2PerfShared();
+        shared_->magic = LV2PerfShared::kMagic;
+        shared_->version = LV2PerfShared::kVersion;
+        shared_->seq.store(0, std::memory_order_release);
+        shm_name_ = name;
+        return true;
+#else
+        (void)name;
+        return false;
+#endif
+    }
+
+    void start() {
+        if (!enabled_ || thread_.joinable()) return;
+        running_ = true;
+        thread_ = std::thread(&LV2PerfMonitor::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    // any thread, the latest published report
+    LV2PerfReport report() const {
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        return report_;
+    }
+
+    // any thread, a copy of the load histogram behind report()
+    LV2LoadHistogram histogram() const {
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        return hist_;
+    }
+
+    // drop everything aggregated so far, keeps running
+    void reset() { reset_.store(true, std::memory_order_release); }
+
+private:
+    struct Totals {
+        uint64_t cycles = 0;
+        uint64_t run_ns = 0;
+        uint32_t run_max_ns = 0;
+        uint32_t cycle_max_ns = 0;
+        uint32_t budget_ns = 0;
+        uint64_t atom_in = 0;
+        uint64_t atom_out = 0;
+        uint64_t worker_msgs = 0;
+        uint64_t denormal_cycles = 0;
+        uint64_t denormal_spikes = 0;
+        uint64_t idle_cycles = 0;
+    };
+
+    void run() {
+        LV2LoadHistogram hist;
+        Totals total;
+        Totals last;    // at the previous report, for the rates
+        uint64_t xrun_base = current_xruns();
+        uint64_t dropped_base = dropped_.load(std::memory_order_relaxed);
+        auto last_report = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            wake_.wait_for(lock, drain_interval);
+            if (reset_.exchange(false, std::memory_order_acq_rel)) {
+                hist.clear();
+                total = last = Totals();
+                xrun_base = current_xruns();
+                dropped_base = dropped_.load(std::memory_order_relaxed);
+            }
+            drain(hist, total);
+
+            const auto now = std::chrono::steady_clock::now();
+            if (now - last_report < report_interval && running_) continue;
+            const double sec = std::chrono::duration<double>(now - last_report).count();
+            last_report = now;
+
+            LV2PerfReport r;
+            r.cycles = total.cycles;
+            r.xruns = current_xruns() - xrun_base;
+            r.dropped = dropped_.load(std::memory_order_relaxed) - dropped_base;
+            r.load_p50 = hist.percentile(0.50) * 1e-6;
+            r.load_p99 = hist.percentile(0.99) * 1e-6;
+            r.load_max = hist.max() * 1e-6;
+            r.run_mean_us = total.cycles ? total.run_ns * 1e-3 / total.cycles : 0.0;
+            r.run_max_us = total.run_max_ns * 1e-3;
+            r.cycle_max_us = total.cycle_max_ns * 1e-3;
+            r.budget_us = total.budget_ns * 1e-3;
+            r.denormal_cycles = total.denormal_cycles;
+            r.denormal_spikes = total.denormal_spikes;
+            r.idle_cycles = total.idle_cycles;
+            if (total.cycles > total.idle_cycles && total.budget_ns) {
+                const double run_ns = (double)total.run_ns / (total.cycles - total.idle_cycles);
+                r.idle_saved = total.idle_cycles * run_ns / ((double)total.cycles * total.budget_ns);
+            }
+            if (sec > 0.0) {
+                r.atom_in_bps = (total.atom_in - last.atom_in) / sec;
+                r.atom_out_bps = (total.atom_out - last.atom_out) / sec;
+                r.worker_msgs_ps = (total.worker_msgs - last.worker_msgs) / sec;
+            }
+            last = total;
+
+            {
+                std::lock_guard<std::mutex> rl(report_mutex_);
+                report_ = r;
+                hist_ = hist;
+            }
+            publish_shared(r, hist);
+            if (on_report_) {
+                lock.unlock();
+                on_report_(r);
+                lock.lock();
+            }
+        }
+    }
+
+    void drain(LV2LoadHistogram& hist, Totals& t) {
+        LV2CycleRecord r;
+        while (lv2_ringbuffer_read_space(ring_) >= sizeof(LV2CycleRecord)) {
+            lv2_ringbuffer_read(ring_, (char*)&r, sizeof(LV2CycleRecord));
+            uint32_t load = 0;
+            if (r.budget_ns) {
+                load = (uint32_t)std::min<uint64_t>(
+                    (uint64_t)r.cycle_ns * 1000000 / r.budget_ns, UINT32_MAX);
+                hist.add(load);
+            }
+            if (r.flags & LV2CycleRecord::kDenormal) {
+                ++t.denormal_cycles;
+                // a median needs some history first
+                if (hist.total() >= 64 && load > 2ull * hist.percentile(0.5))
+                    ++t.denormal_spikes;
+            }
+            if (r.flags & LV2CycleRecord::kIdle) ++t.idle_cycles;
+            ++t.cycles;
+            t.run_ns += r.run_ns;
+            t.run_max_ns = std::max(t.run_max_ns, r.run_ns);
+            t.cycle_max_ns = std::max(t.cycle_max_ns, r.cycle_ns);
+            t.budget_ns = r.budget_ns;
+            t.atom_in += r.atom_in_bytes;
+            t.atom_out += r.atom_out_bytes;
+            t.worker_msgs += r.worker_msgs;
+        }
+    }
+
+    uint64_t current_xruns() const {
+        return xrun_source_ ? xrun_source_() : xruns_.load(std::memory_order_relaxed);
+    }
+
+    void publish_shared(const LV2PerfReport& r, const LV2LoadHistogram& hist) {
+        if (!shared_) return;
+        const uint32_t s = shared_->seq.load(std::memory_order_relaxed);
+        shared_->seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        shared_->report = r;
+        for (uint32_t i = 0; i < LV2LoadHistogram::kBuckets; ++i)
+            shared_->histogram[i] = hist.count(i);
+        shared_->seq.store(s + 2, std::memory_order_release);
+    }
+
+    void unmap_shared() {
+#if !defined(__ANDROID__)
+        if (!shared_) return;
+        munmap(shared_, sizeof(LV2PerfShared));
+        shm_unlink(shm_name_.c_str());
+        shared_ = nullptr;
+#endif
+    }
+
+    lv2_ringbuffer_t* ring_ = nullptr;
+    bool enabled_ = false;
+    std::atomic<uint64_t> xruns_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> reset_{false};
+    std::function<uint64_t()> xrun_source_;
+    std::function<void(const LV2PerfReport&)> on_report_;
+
+    LV2PerfShared* shared_ = nullptr;
+    std::string shm_name_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+    std::thread thread_;
+
+    mutable std::mutex report_mutex_;
+    LV2PerfReport report_;
+    LV2LoadHistogram hist_;
+};
@@ -11,6 +11,7 @@
  * - Control port management (float, toggle, trigger)
  * - Atom port communication (UI↔DSP via lock-free ringbuffers)
  * - Worker thread support for non-RT plugin tasks
+ * - MIDI staged by the backend, linked copies of one plugin on more channels
  * - URID mapping and LV2 feature negotiation
  * - State save/load via Lilv
  *
@@ -20,6 +21,15 @@
 #pragma once
 
 #include "lv2_ringbuffer.h"
+#include "LV2HostStats.hpp"
+#include "LV2PerfMonitor.hpp"
+#include "LV2Automation.hpp"
+#include "LV2URIDMap.hpp"
+#include "LV2RTMemory.hpp"
+#include "LV2Denormals.hpp"
+#include "LV2BlockAdapter.hpp"
+#include "LV2IdleGate.hpp"
+#include "LV2StatePipeline.hpp"
 #include <lilv/lilv.h>
 
 #include <lv2/urid/urid.h>
@@ -34,22 +44,80 @@
 #include <lv2/state/state.h>
 #include <lv2/resize-port/resize-port.h>
 #include <lv2/midi/midi.h>
+#include <lv2/port-props/port-props.h>
+
+#include <semaphore.h>
 
 #include <atomic>
 #include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 #include <variant>
 
+// ============================================================================
+// AtomSpan - Non-owning view of an atom body (std::span stand-in for C++17)
+// ============================================================================
+
+struct AtomSpan {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// ============================================================================
+// ControlRange - Range of a control port
+// ============================================================================
+
+// The one clamp every control setter goes through. A bound the port does
+// not declare is open.
+struct ControlRange {
+    float minval = -std::numeric_limits<float>::max();
+    float maxval = std::numeric_limits<float>::max();
+    float defvalue = 0.0f;
+    bool snap = false;          // toggles and triggers store 0 or 1
+
+    float clamp(float value) const {
+        return snap ? (value > 0.5f ? 1.0f : 0.0f) : std::clamp(value, minval, maxval);
+    }
+
+    // lv2:minimum, lv2:maximum and lv2:default of the port
+    static ControlRange read(const LilvPlugin* plugin, const LilvPort* port) {
+        ControlRange r;
+        LilvNode *pmin, *pmax, *pdflt;
+        lilv_port_get_range(plugin, port, &pdflt, &pmin, &pmax);
+        if (pmin) {
+            r.minval = lilv_node_as_float(pmin);
+            lilv_node_free(pmin);
+        }
+        if (pmax) {
+            r.maxval = lilv_node_as_float(pmax);
+            lilv_node_free(pmax);
+        }
+        if (pdflt) {
+            r.defvalue = lilv_node_as_float(pdflt);
+            lilv_node_free(pdflt);
+        }
+        return r;
+    }
+};
+
 // ============================================================================
 // PluginControl - Abstract Base Class & Factory
 // ============================================================================
 
+// getValue()/setValue() are the generic, variant based interface. Float,
+// toggle and trigger controls also share a typed fast path: setFloat() and
+// getFloat() are non-virtual and work directly on the value the plugin port
+// is connected to (a slot in LV2Plugin's contiguous control array), so they
+// neither allocate nor dispatch.
 class PluginControl {
 public:
     virtual ~PluginControl() = default;
@@ -68,10 +136,41 @@ public:
     virtual const LilvPort* getPort() const = 0;
     virtual void reset() = 0;
 
+    // Plugin port index, see LV2Plugin::getControlHandle()
+    uint32_t getPortIndex() const { return port_index_; }
+
+    // Typed fast path. Floats clamp to the port range, toggles and triggers
+    // store 0 or 1; a trigger is reset by the plugin host after one cycle.
+    float getFloat() const { return *slot_; }
+    void setFloat(float value) { *slot_ = range_->clamp(value); }
+
+    const ControlRange& getRange() const { return *range_; }
+
+    // Points the control at the value the port is connected to and at the
+    // plugin's range table, see LV2Plugin::init_ports(). Until then the
+    // control keeps its own value and range.
+    void bind(float* slot, const ControlRange* range) {
+        slot_ = slot ? slot : &own_value_;
+        range_ = range ? range : &own_range_;
+    }
+
     // Factory: caller owns returned pointer
     static PluginControl* create(LilvWorld* world, const LilvPlugin* plugin,
                                   const LilvPort* port, const LilvNode* audio_class,
                                   const LilvNode* control_class, const LilvNode* atom_class);
+
+protected:
+    void setRange(const ControlRange& range) {
+        own_range_ = range;
+        *slot_ = range.defvalue;
+    }
+
+private:
+    uint32_t port_index_ = 0;
+    float own_value_ = 0.0f;
+    float* slot_ = &own_value_;
+    ControlRange own_range_;
+    const ControlRange* range_ = &own_range_;
 };
 
 // ============================================================================
@@ -80,57 +179,32 @@ public:
 
 class ControlPortFloat : public PluginControl {
 public:
-    ControlPortFloat(LilvWorld* world, const LilvPlugin* plugin,
+    ControlPortFloat(LilvWorld* /*world*/, const LilvPlugin* plugin,
                      const LilvPort* port)
-        : port_(port), value_(0.0f), defvalue_(0.0f), minval_(0.0f), maxval_(1.0f) {
+        : port_(port) {
         
         // Extract port symbol
         const LilvNode* sym = lilv_port_get_symbol(plugin, port);
         symbol_ = sym ? lilv_node_as_string(sym) : "";
         
-        // Extract min/max/default
-        LilvNode *pmin, *pmax, *pdflt;
-        lilv_port_get_range(plugin, port, &pdflt, &pmin, &pmax);
-        
-        if (pmin) {
-            minval_ = lilv_node_as_float(pmin);
-            lilv_node_free(pmin);
-        }
-        if (pmax) {
-            maxval_ = lilv_node_as_float(pmax);
-            lilv_node_free(pmax);
-        }
-        if (pdflt) {
-            defvalue_ = lilv_node_as_float(pdflt);
-            lilv_node_free(pdflt);
-        }
-        
-        value_ = defvalue_;
+        setRange(ControlRange::read(plugin, port));
     }
     
     void setValue(const std::variant<float, bool, std::vector<uint8_t>>& val) override {
-        try {
-            float fval = std::get<float>(val);
-            value_ = std::clamp(fval, minval_, maxval_);
-        } catch (const std::bad_variant_access&) {
-            // Type mismatch, ignore
-        }
+        if (const float* fval = std::get_if<float>(&val)) setFloat(*fval);
     }
     
     std::variant<float, bool, std::vector<uint8_t>> getValue() const override {
-        return value_;
+        return getFloat();
     }
     
     Type getType() const override { return Type::ControlFloat; }
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
-    void reset() override { value_ = defvalue_; }
-    
-    float* getValuePtr() { return &value_; }
+    void reset() override { setFloat(getRange().defvalue); }
 
 private:
     const LilvPort* port_;
-    float value_, defvalue_, minval_, maxval_;
     std::string symbol_;
 };
 
@@ -140,51 +214,35 @@ private:
 
 class ToggleControl : public PluginControl {
 public:
-    ToggleControl(LilvWorld* world, const LilvPlugin* plugin,
+    ToggleControl(LilvWorld* /*world*/, const LilvPlugin* plugin,
                   const LilvPort* port)
-        : port_(port), value_(false), defvalue_(false) {
+        : port_(port) {
         
         const LilvNode* sym = lilv_port_get_symbol(plugin, port);
         symbol_ = sym ? lilv_node_as_string(sym) : "";
         
-        LilvNode *pmin, *pmax, *pdflt;
-        lilv_port_get_range(plugin, port, &pdflt, &pmin, &pmax);
-        if (pdflt) {
-            defvalue_ = lilv_node_as_float(pdflt) > 0.5f;
-            lilv_node_free(pdflt);
-        }
-        if (pmin) lilv_node_free(pmin);
-        if (pmax) lilv_node_free(pmax);
-        
-        value_ = defvalue_;
+        const bool defvalue = ControlRange::read(plugin, port).defvalue > 0.5f;
+        setRange({ 0.0f, 1.0f, defvalue ? 1.0f : 0.0f, true });
     }
     
     void setValue(const std::variant<float, bool, std::vector<uint8_t>>& val) override {
-        try {
-            value_ = std::get<bool>(val);
-        } catch (const std::bad_variant_access&) {
-            try {
-                value_ = std::get<float>(val) > 0.5f;
-            } catch (const std::bad_variant_access&) {
-                // Type mismatch, ignore
-            }
-        }
+        if (const bool* b = std::get_if<bool>(&val)) setFloat(*b ? 1.0f : 0.0f);
+        else if (const float* f = std::get_if<float>(&val)) setFloat(*f);
     }
     
     std::variant<float, bool, std::vector<uint8_t>> getValue() const override {
-        return value_;
+        return getFloat() > 0.5f;
     }
     
     Type getType() const override { return Type::Toggle; }
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
-    void reset() override { value_ = defvalue_; }
+    void reset() override { setFloat(getRange().defvalue); }
     
-    float getAsFloat() const { return value_ ? 1.0f : 0.0f; }
+    float getAsFloat() const { return getFloat(); }
 
 private:
     const LilvPort* port_;
-    bool value_, defvalue_;
     std::string symbol_;
 };
 
@@ -194,41 +252,35 @@ private:
 
 class TriggerControl : public PluginControl {
 public:
-    TriggerControl(LilvWorld* world, const LilvPlugin* plugin,
+    TriggerControl(LilvWorld* /*world*/, const LilvPlugin* plugin,
                    const LilvPort* port)
-        : port_(port), armed_(false) {
+        : port_(port) {
         
         const LilvNode* sym = lilv_port_get_symbol(plugin, port);
         symbol_ = sym ? lilv_node_as_string(sym) : "";
+        setRange({ 0.0f, 1.0f, 0.0f, true });
     }
     
     void setValue(const std::variant<float, bool, std::vector<uint8_t>>& val) override {
-        try {
-            armed_ = std::get<bool>(val);
-        } catch (const std::bad_variant_access&) {
-            try {
-                armed_ = std::get<float>(val) > 0.5f;
-            } catch (const std::bad_variant_access&) {
-                // Type mismatch
-            }
-        }
+        if (const bool* b = std::get_if<bool>(&val)) setFloat(*b ? 1.0f : 0.0f);
+        else if (const float* f = std::get_if<float>(&val)) setFloat(*f);
     }
     
     std::variant<float, bool, std::vector<uint8_t>> getValue() const override {
-        return armed_;
+        return isArmed();
     }
     
     Type getType() const override { return Type::Trigger; }
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
-    void reset() override { armed_ = false; }
+    void reset() override { setFloat(0.0f); }
     
-    bool isArmed() { return armed_; }
-    float getAsFloat() const { return armed_ ? 1.0f : 0.0f; }
+    // True until the cycle that sees the trigger has run
+    bool isArmed() const { return getFloat() > 0.5f; }
+    float getAsFloat() const { return getFloat(); }
 
 private:
     const LilvPort* port_;
-    bool armed_;
     std::string symbol_;
 };
 
@@ -237,18 +289,25 @@ private:
 // ============================================================================
 
 struct AtomState {
-    std::vector<uint8_t> ui_to_dsp;
-    uint32_t ui_to_dsp_type = 0;
-    std::atomic<bool> ui_to_dsp_pending{false};
+    // Framed LV2_Atom messages (header + body) in both directions
+    lv2_ringbuffer_t* ui_to_dsp = nullptr;
     lv2_ringbuffer_t* dsp_to_ui = nullptr;
-    
+
     AtomState(size_t ringbuffer_size = 16384) {
+        ui_to_dsp = lv2_ringbuffer_create(ringbuffer_size);
         dsp_to_ui = lv2_ringbuffer_create(ringbuffer_size);
     }
-    
+
     ~AtomState() {
+        if (ui_to_dsp) lv2_ringbuffer_free(ui_to_dsp);
         if (dsp_to_ui) lv2_ringbuffer_free(dsp_to_ui);
     }
+
+    // Non-RT: queue one atom for the plugin, false when the queue is full
+    bool write_ui_message(uint32_t type, uint32_t size, const void* body) {
+        const LV2_Atom hdr { size, type };
+        return lv2_ringbuffer_write_msg(ui_to_dsp, &hdr, sizeof(LV2_Atom), body, size);
+    }
 };
 
 // ============================================================================
@@ -257,47 +316,52 @@ struct AtomState {
 
 class AtomPortControl : public PluginControl {
 public:
-    AtomPortControl(LilvWorld* world, const LilvPlugin* plugin,
+    AtomPortControl(LilvWorld* /*world*/, const LilvPlugin* plugin,
                     const LilvPort* port)
         : port_(port) {
         
         const LilvNode* sym = lilv_port_get_symbol(plugin, port);
         symbol_ = sym ? lilv_node_as_string(sym) : "";
-        
-        // Create shared atom state
-        atom_state_ = new AtomState();
-    }
-    
-    ~AtomPortControl() override {
-        delete atom_state_;
     }
-    
+
+    // Queues the body as one atom of the type set with setMessageType()
     void setValue(const std::variant<float, bool, std::vector<uint8_t>>& val) override {
-        try {
-            auto data = std::get<std::vector<uint8_t>>(val);
-            // TODO: how to get type? For now, store data and wait for caller to set type
-            atom_state_->ui_to_dsp = data;
-            atom_state_->ui_to_dsp_pending.store(true, std::memory_order_release);
-        } catch (const std::bad_variant_access&) {
-            // Type mismatch, ignore
-        }
+        if (const auto* data = std::get_if<std::vector<uint8_t>>(&val))
+            setBytes(AtomSpan{ data->data(), data->size() });
     }
-    
+
+    // Last message body queued through this control
     std::variant<float, bool, std::vector<uint8_t>> getValue() const override {
-        return atom_state_->ui_to_dsp;
+        return last_;
     }
-    
+
+    // Fast path: queue a body without building a vector. The copy kept for
+    // getBytes() reuses its capacity, so same sized messages don't allocate.
+    bool setBytes(AtomSpan body) {
+        if (!atom_state_ || !message_type_) return false;
+        if (!atom_state_->write_ui_message(message_type_, body.size, body.data)) return false;
+        last_.assign(body.data, body.data + body.size);
+        return true;
+    }
+
+    // View of the last queued body, valid until the next setBytes()
+    AtomSpan getBytes() const { return AtomSpan{ last_.data(), last_.size() }; }
+
     Type getType() const override { return Type::AtomPort; }
     const char* getSymbol() const override { return symbol_.c_str(); }
     const LilvPort* getPort() const override { return port_; }
-    void reset() override { atom_state_->ui_to_dsp.clear(); }
-    
+    void reset() override { last_.clear(); }
+
+    // The state is owned by the plugin port, see LV2Plugin::init_ports()
+    void attachAtomState(AtomState* state) { atom_state_ = state; }
     AtomState* getAtomState() { return atom_state_; }
-    void setMessageType(uint32_t type_urid) { atom_state_->ui_to_dsp_type = type_urid; }
+    void setMessageType(uint32_t type_urid) { message_type_ = type_urid; }
 
 private:
     const LilvPort* port_;
-    AtomState* atom_state_;
+    AtomState* atom_state_ = nullptr;
+    uint32_t message_type_ = 0;
+    std::vector<uint8_t> last_;
     std::string symbol_;
 };
 
@@ -309,16 +373,20 @@ class LV2Plugin {
 public:
     // Constructor: caller provides discovered Lilv world and plugin
     LV2Plugin(LilvWorld* world, LilvPlugin* plugin, double sample_rate, uint32_t max_block_length)
-        : world_(world), plugin_(plugin), sample_rate_(sample_rate),
-          max_block_length_(max_block_length), instance_(nullptr),
-          required_atom_size_(8192), shutdown_(false) {
+        : world_(world), plugin_(plugin), instance_(nullptr),
+          audio_class_(nullptr), control_class_(nullptr), atom_class_(nullptr),
+          input_class_(nullptr), rsz_minimumSize_(nullptr),
+          sample_rate_(sample_rate), max_block_length_(max_block_length),
+          required_atom_size_(8192), worker_size_(8192), denormal_protection_(true), shutdown_(false) {
     }
 
     // Constructor: resolve plugin by URI from an existing Lilv world
     LV2Plugin(LilvWorld* world, const char* plugin_uri, double sample_rate, uint32_t max_block_length)
-        : world_(world), plugin_(nullptr), sample_rate_(sample_rate),
-          max_block_length_(max_block_length), instance_(nullptr),
-          required_atom_size_(8192), shutdown_(false) {
+        : world_(world), plugin_(nullptr), instance_(nullptr),
+          audio_class_(nullptr), control_class_(nullptr), atom_class_(nullptr),
+          input_class_(nullptr), rsz_minimumSize_(nullptr),
+          sample_rate_(sample_rate), max_block_length_(max_block_length),
+          required_atom_size_(8192), worker_size_(8192), denormal_protection_(true), shutdown_(false) {
         if (world_ && plugin_uri) {
             const LilvPlugins* plugins = lilv_world_get_all_plugins(world_);
             LilvNode* uri = lilv_new_uri(world_, plugin_uri);
@@ -348,9 +416,14 @@ public:
         init_features();
         
         if (!check_resize_port_requirements()) return false;
+        configure_block_length();
         if (!init_ports()) return false;
+        block_adapter_.configure(std::max<uint32_t>({ getAudioInputCount() * instance_count_,
+                                                      getAudioOutputCount() * instance_count_, 2u }),
+                                 block_length_, fixed_block_);
         if (!init_instance()) return false;
 
+        lock_rt_buffers();
         return true;
     }
 
@@ -358,28 +431,55 @@ public:
     void start() {
         shutdown_.store(false, std::memory_order_release);
         if (instance_) lilv_instance_activate(instance_);
+        for (auto& c : copies_) lilv_instance_activate(c->instance);
     }
 
     void stop() {
         shutdown_.store(true, std::memory_order_release);
         if (instance_) lilv_instance_deactivate(instance_);
+        for (auto& c : copies_) lilv_instance_deactivate(c->instance);
     }
 
     void closePlugin() {
-        stop_worker();
+        // a state job in flight finishes first, queued ones are skipped
+        state_guard_->revoke();
+        state_guard_ = std::make_shared<LV2JobGuard>();
+        own_state_thread_.reset();
+        state_thread_ = nullptr;
+        stop_worker(host_worker_, restore_worker_);
+        for (auto& c : copies_) stop_worker(c->worker, c->restore_worker);
 
         if (instance_) {
             lilv_instance_deactivate(instance_);
             lilv_instance_free(instance_);
             instance_ = nullptr;
         }
+        for (auto& c : copies_) {
+            lilv_instance_deactivate(c->instance);
+            lilv_instance_free(c->instance);
+            for (auto* seq : c->atom_out) free(seq);
+        }
+        copies_.clear();
 
         // Free port buffers and controls
+        automation_.clear();
+        control_queue_ = nullptr;
         for (auto& p : ports_) {
             if (p.atom) free(p.atom);
+            free(p.atom_slice);
+            free(p.midi_stage);
             delete p.atom_state;
         }
         ports_.clear();
+        port_meta_.clear();
+        ranges_.clear();
+        symbol_index_.clear();
+        control_by_port_.clear();
+        control_values_.clear();
+        latency_port_ = UINT32_MAX;
+        idle_gate_.configure(0);
+        idle_controls_.clear();
+        tables_.clear();
         
         for (auto* control : controls_) {
             delete control;
@@ -392,163 +492,398 @@ public:
         if (atom_class_) lilv_node_free(atom_class_);
         if (input_class_) lilv_node_free(input_class_);
         if (rsz_minimumSize_) lilv_node_free(rsz_minimumSize_);
+        audio_class_ = control_class_ = atom_class_ = nullptr;
+        input_class_ = rsz_minimumSize_ = nullptr;
     }
 
     // RT-safe audio processing with atom message handling
     bool process(float* inputBuffer, float* outputBuffer, int numFrames) {
+        return process(&inputBuffer, &outputBuffer, 1, numFrames);
+    }
+
+    // RT-safe planar processing: audio ports are mapped onto the channel
+    // buffers in port order. Inputs wrap around when the plugin has more
+    // input ports than channels, surplus outputs go to a scratch buffer and
+    // channels without a plugin output carry their input through.
+    // Callbacks longer than the plugin's block length are split, a plugin
+    // running at a fixed block length goes through a FIFO of
+    // getBlockLatency() frames. Hosts timing their cycles pass a record,
+    // the plugin adds its run time, atom traffic and flags.
+    // With setInstanceCount() copy j takes the channels after those of
+    // copies 0 .. j-1, e.g. inputs j * getAudioInputCount() and up.
+    bool process(float* const* inputs, float* const* outputs,
+                 uint32_t channels, int numFrames, LV2CycleRecord* cycle = nullptr) {
         if (shutdown_.load(std::memory_order_acquire) || !instance_)
             return false;
 
-        if (!inputBuffer || !outputBuffer || numFrames <= 0)
+        if (!inputs || !outputs || channels == 0 || numFrames <= 0 ||
+            channels > block_adapter_.channels())
             return false;
 
-        // --- Step A: Connect audio port buffers ---
-        uint32_t input_index = 0, output_index = 0;
-        for (auto& p : ports_) {
-            if (!p.is_audio) continue;
-            
-            float* target = inputBuffer;
-            if (!p.is_input) target = outputBuffer;
-            lilv_instance_connect_port(instance_, p.index, target);
+        // MIDI the last call sent is gone, see forEachMidiOutput()
+        retire_midi_output(midi_out_frames_);
+        midi_out_frames_ = numFrames;
+
+        // restore() of a plugin without threadSafeRestore is running: UI
+        // messages stay queued, staged MIDI waits for the next call
+        if (!state_pause_.enter()) {
+            for (uint32_t c = 0; c < channels; ++c)
+                memset(outputs[c], 0, numFrames * sizeof(float));
+            age_midi_input(numFrames);
+            return true;
         }
+        if (port_swap_.apply([this](uint32_t port, float value) { control_values_[port] = value; }))
+            values_restored_.store(true, std::memory_order_release);
+
+        // a fixed block started with the frames the FIFO already holds,
+        // before this call
+        block_pos_ = -(int64_t)block_adapter_.fill();
+        block_adapter_.process(inputs, outputs, channels, numFrames,
+            [this, channels, cycle](float* const* in, float* const* out, uint32_t frames) {
+                process_block(in, out, channels, frames, cycle);
+                block_pos_ += frames;
+            });
+        automation_.setBuffered(block_adapter_.fill());
+        age_midi_input(numFrames);
+        state_pause_.leave();
+        return true;
+    }
 
-        // --- Step B: Process incoming UI→DSP atom messages ---
-        for (auto& p : ports_) {
-            if (!p.is_atom || !p.is_input) continue;
-            
-            // Check for pending UI message
-            if (p.atom_state->ui_to_dsp_pending.exchange(false, std::memory_order_acquire)) {
-                // Wrap UI data in LV2_Atom_Event and append to sequence
-                p.atom->atom.type = urids_.atom_Sequence;
-                p.atom->atom.size = 0;
-                
-                const uint32_t body_size = p.atom_state->ui_to_dsp.size();
-                uint8_t evbuf[sizeof(LV2_Atom_Event) + body_size];
-                LV2_Atom_Event* ev = (LV2_Atom_Event*)evbuf;
-                
-                ev->time.frames = 0;
-                ev->body.type = p.atom_state->ui_to_dsp_type;
-                ev->body.size = body_size;
-                memcpy((uint8_t*)LV2_ATOM_BODY(&ev->body),
-                       p.atom_state->ui_to_dsp.data(), body_size);
-                
-                lv2_atom_sequence_append_event(p.atom, p.atom_buf_size, ev);
+    // RT, on the thread calling process(): stage a MIDI event for a MIDI
+    // input port, frame counted from the start of the next process() call.
+    // It follows the UI messages of the block it falls into; at a fixed
+    // block length it reaches the plugin with the audio of its frame, both
+    // getBlockLatency() later. False (and
+    // counted in midi_in_dropped) when the port buffer is full.
+    bool writeMidiInput(uint32_t portIndex, uint32_t frame, const uint8_t* data, uint32_t size) {
+        if (portIndex >= ports_.size() || !ports_[portIndex].is_input || !ports_[portIndex].midi_stage)
+            return false;
+        Port& p = ports_[portIndex];
+        if (append_event(p.midi_stage, p.stage_size - sizeof(LV2_Atom), frame,
+                         urids_.midi_Event, size, data))
+            return true;
+        LV2HostStats::inc(stats_.midi_in_dropped);
+        return false;
+    }
+
+    // RT, after process(): fn(portIndex, frame, data, size) for every MIDI
+    // event the plugin sent for that call, frames counted from its start.
+    // At a fixed block length events play out with the audio of their
+    // block, getBlockLatency() after the plugin sent them. fn returns false
+    // when the backend refused the event.
+    template <typename Fn>
+    void forEachMidiOutput(Fn&& fn) {
+        for (uint32_t i : tables_.midi_out) {
+            LV2_ATOM_SEQUENCE_FOREACH(ports_[i].midi_stage, ev) {
+                if (ev->time.frames >= midi_out_frames_) break;
+                if (!fn(i, (uint32_t)ev->time.frames, (const uint8_t*)LV2_ATOM_BODY(&ev->body),
+                        ev->body.size))
+                    LV2HostStats::inc(stats_.midi_out_dropped);
             }
         }
+    }
 
-        // --- Step C: Run plugin ---
-        lilv_instance_run(instance_, numFrames);
+    // RT counters, safe to read from any thread
+    const LV2HostStats& getStats() const { return stats_; }
+
+    // Largest worker message in bytes, call before initialize()
+    void setWorkerSize(uint32_t bytes) { worker_size_ = bytes; }
+
+    // MIDI events per frame a MIDI port buffer holds, call before
+    // initialize(). 1.0 (default) covers dense MPE and 14-bit CC streams.
+    void setMidiEventDensity(float eventsPerFrame) { midi_event_density_ = eventsPerFrame; }
+
+    // Run n linked copies of the plugin, e.g. a mono effect on every
+    // channel of a bus. They share the control and atom inputs; each has
+    // its own worker, audio ports and control/atom outputs, of which only
+    // the audio reaches the host. Call before initialize().
+    void setInstanceCount(uint32_t n) { instance_count_ = std::max(1u, n); }
+    uint32_t getInstanceCount() const { return instance_count_; }
+
+    // Run the plugin at exactly this many frames per run() through a FIFO,
+    // e.g. for FFT plugins, call before initialize(). 0 (default) runs at
+    // the caller's block sizes unless the plugin requires a fixed or power
+    // of two block length.
+    void setFixedBlockLength(uint32_t frames) { fixed_block_length_ = frames; }
+
+    // Frames per run() the plugin was told, and the latency the FIFO of a
+    // fixed block length adds (0 otherwise)
+    uint32_t getBlockLength() const { return block_length_; }
+    uint32_t getBlockLatency() const { return block_adapter_.latency(); }
+
+    // Frames between input and output: what the plugin reports on its
+    // lv2:reportsLatency output after the last run(), plus the block
+    // latency. RT-safe, hosts poll it after process() to notice changes.
+    uint32_t getLatency() const {
+        uint32_t frames = block_adapter_.latency();
+        if (latency_port_ != UINT32_MAX) {
+            const float value = control_values_[latency_port_];
+            if (value > 0.0f) frames += (uint32_t)(value + 0.5f);
+        }
+        return frames;
+    }
 
-        // --- Step D: Deliver worker responses ---
-        if (host_worker_.iface) deliver_worker_responses();
+    // Skip run() once inputs and outputs stayed below threshold for
+    // tail_seconds (plus the plugin latency) with no events or control
+    // changes, outputs are silent meanwhile; see LV2IdleGate.hpp. 0
+    // disables it (default). Call after initialize(), before process().
+    void setIdleBypass(float tail_seconds,
+                       float threshold = LV2IdleGate::kDefaultThreshold) {
+        idle_gate_.configure((uint32_t)(std::max(0.0f, tail_seconds) * sample_rate_), threshold);
+        idle_controls_.assign(tables_.control_in.size(), 0.0f);
+        for (size_t k = 0; k < idle_controls_.size(); ++k)
+            idle_controls_[k] = control_values_[tables_.control_in[k]];
+    }
 
-        // --- Step E: Read outgoing DSP→UI atom messages ---
-        for (auto& p : ports_) {
-            // Reset input atom port for next cycle
-            if (p.is_atom && p.is_input) {
-                p.atom->atom.size = 0;
-            }
+    // True while the idle gate skips run()
+    bool isIdle() const { return idle_gate_.idle(); }
 
-            // Copy output atoms to ringbuffer
-            if (p.is_atom && !p.is_input) {
-                LV2_Atom_Sequence* seq = p.atom;
-                LV2_ATOM_SEQUENCE_FOREACH(seq, ev) {
-                    if (ev->body.size == 0) break;
-                    if (seq->atom.type == 0) break;
-                    
-                    const uint32_t total = sizeof(LV2_Atom) + ev->body.size;
-                    if (lv2_ringbuffer_write_space(p.atom_state->dsp_to_ui) >= total) {
-                        lv2_ringbuffer_write(p.atom_state->dsp_to_ui,
-                                           (const char*)&ev->body, total);
-                    }
-                }
-                
-                // Reset output buffer for next process cycle
-                p.atom->atom.type = 0;
-                p.atom->atom.size = required_atom_size_;
-            }
-        }
+    // Flush-to-zero/denormals-are-zero on the threads calling process()
+    // and on the worker, on by default. Call before initialize().
+    void setDenormalProtection(bool on) { denormal_protection_ = on; }
+
+    // Audio ports of one instance
+    uint32_t getAudioInputCount() const { return tables_.audio_in.size(); }
+    uint32_t getAudioOutputCount() const { return tables_.audio_out.size(); }
+    // Most channels process() takes
+    uint32_t getMaxChannels() const { return block_adapter_.channels(); }
 
+    // Control access, hashed by symbol
+    PluginControl* getControl(const char* symbol) {
+        const uint32_t i = find_port(symbol);
+        return i < control_by_port_.size() ? control_by_port_[i] : nullptr;
+    }
+
+    // A control input resolved once, then set/read without any lookup
+    struct ControlHandle {
+        uint32_t port = UINT32_MAX;
+        bool valid() const { return port != UINT32_MAX; }
+    };
+
+    ControlHandle getControlHandle(const char* symbol) const {
+        return control_handle(find_port(symbol));
+    }
+
+    ControlHandle getControlHandle(const PluginControl* control) const {
+        return control ? control_handle(control->getPortIndex()) : ControlHandle{};
+    }
+
+    // UI/automation thread: clamps to the port range (toggles and triggers
+    // snap to 0/1), the next process() cycle runs with the value
+    bool setValue(ControlHandle h, float value) {
+        if (!h.valid() || h.port >= ports_.size()) return false;
+        control_values_[h.port] = ranges_[h.port].clamp(value);
         return true;
     }
 
-    // Control access
-    PluginControl* getControl(const char* symbol) {
-        for (auto* control : controls_) {
-            if (std::string(control->getSymbol()) == symbol)
-                return control;
+    float getValue(ControlHandle h) const {
+        return h.valid() && h.port < ports_.size() ? control_values_[h.port] : 0.0f;
+    }
+
+    // A control input by port index, for hosts that address ports the way
+    // the plugin numbers them
+    ControlHandle getControlHandleAt(uint32_t portIndex) const {
+        return control_handle(portIndex);
+    }
+
+    // Current value of any control port, inputs and outputs. RT-safe, a
+    // host reads the outputs after process().
+    float getControlValueAt(uint32_t portIndex) const {
+        return portIndex < ports_.size() && ports_[portIndex].is_control
+             ? control_values_[portIndex] : 0.0f;
+    }
+
+    // Range of a control port, nullptr for any other port
+    const ControlRange* getControlRangeAt(uint32_t portIndex) const {
+        return portIndex < ports_.size() && ports_[portIndex].is_control
+             ? &ranges_[portIndex] : nullptr;
+    }
+
+    // One producer thread: clamped to the port range and queued for the
+    // start of the next process(), in order and with the port's smoothing.
+    // Jumps right away when the queue is full.
+    bool queueValue(ControlHandle h, float value) {
+        if (!h.valid() || h.port >= ports_.size()) return false;
+        value = ranges_[h.port].clamp(value);
+        if (!control_queue_ || !control_queue_->push(h.port, value))
+            control_values_[h.port] = value;
+        return true;
+    }
+
+    // Timestamped control changes, sub-block splits and ramps, see
+    // LV2Automation.hpp. Set smoothing, block size and add one queue per
+    // further producer thread after initialize(), before process() runs.
+    LV2Automation& getAutomation() { return automation_; }
+
+    // Ramp every continuous control input over ms, stepped ports (toggled,
+    // integer, enumeration, trigger) keep jumping. After initialize().
+    void setControlSmoothing(float ms, LV2RampCurve curve = LV2RampCurve::Linear) {
+        const uint32_t frames = (uint32_t)(std::max(0.0f, ms) * sample_rate_ / 1000.0);
+        const char* stepped[] = { LV2_CORE__toggled, LV2_CORE__integer,
+                                  LV2_CORE__enumeration, LV2_PORT_PROPS__trigger };
+        LilvNode* props[4];
+        for (int k = 0; k < 4; ++k) props[k] = lilv_new_uri(world_, stepped[k]);
+        for (uint32_t i : tables_.control_in) {
+            bool step = false;
+            for (int k = 0; k < 4 && !step; ++k)
+                step = lilv_port_has_property(plugin_, port_meta_[i].lilv_port, props[k]);
+            automation_.setSmoothing(i, step ? 0 : frames, curve);
         }
-        return nullptr;
+        for (int k = 0; k < 4; ++k) lilv_node_free(props[k]);
     }
 
     uint32_t getPortCount() const { return ports_.size(); }
     const LilvPort* getPort(uint32_t index) const {
-        if (index >= ports_.size()) return nullptr;
-        return ports_[index].lilv_port;
+        if (index >= port_meta_.size()) return nullptr;
+        return port_meta_[index].lilv_port;
     }
 
+    // Port index by symbol, hashed, UINT32_MAX when unknown
+    uint32_t findPort(const char* symbol) const { return find_port(symbol); }
+
     // Get ringbuffer for reading DSP→UI atoms
     lv2_ringbuffer_t* getAtomOutputRingbuffer(const char* portSymbol) {
-        for (auto& p : ports_) {
-            if (!p.is_atom || p.is_input) continue;
-            const LilvNode* sym = lilv_port_get_symbol(plugin_, p.lilv_port);
-            if (sym && std::string(lilv_node_as_string(sym)) == portSymbol) {
-                return p.atom_state->dsp_to_ui;
-            }
-        }
-        return nullptr;
+        const uint32_t i = find_port(portSymbol);
+        if (i == UINT32_MAX || !ports_[i].is_atom || ports_[i].is_input) return nullptr;
+        return ports_[i].atom_state->dsp_to_ui;
+    }
+
+    lv2_ringbuffer_t* getAtomOutputRingbufferAt(uint32_t portIndex) {
+        if (portIndex >= ports_.size() || !ports_[portIndex].is_atom || ports_[portIndex].is_input)
+            return nullptr;
+        return ports_[portIndex].atom_state->dsp_to_ui;
+    }
+
+    // Queue an atom for an input atom port, false when full or not found
+    bool writeAtomMessage(const char* portSymbol, uint32_t type,
+                          uint32_t size, const void* body) {
+        return writeAtomMessageAt(find_port(portSymbol), type, size, body);
+    }
+
+    bool writeAtomMessageAt(uint32_t portIndex, uint32_t type,
+                            uint32_t size, const void* body) {
+        if (portIndex >= ports_.size() || !ports_[portIndex].is_atom || !ports_[portIndex].is_input)
+            return false;
+        return ports_[portIndex].atom_state->write_ui_message(type, size, body);
     }
 
-    // Helper to read atoms from ringbuffer
+    // Helper to read atoms from ringbuffer (copies one atom into outBuffer)
     static size_t readAtomMessage(lv2_ringbuffer_t* rb, uint8_t* outBuffer, size_t maxSize) {
         if (!rb || !outBuffer || maxSize < sizeof(LV2_Atom)) return 0;
-        
+
         if (lv2_ringbuffer_read_space(rb) < sizeof(LV2_Atom)) return 0;
-        
+
         LV2_Atom atom_header;
         lv2_ringbuffer_peek(rb, (char*)&atom_header, sizeof(LV2_Atom));
-        
+
         const uint32_t total = sizeof(LV2_Atom) + atom_header.size;
         if (total > maxSize || lv2_ringbuffer_read_space(rb) < total) return 0;
-        
-        lv2_ringbuffer_read(rb, (char*)outBuffer, total);
+
+        lv2_ringbuffer_peek(rb, (char*)outBuffer, total);
+        lv2_ringbuffer_release_msg(rb, total);
         return total;
     }
 
+    // Zero-copy visit of every pending atom, fn(const LV2_Atom*) gets a
+    // pointer into the ringbuffer unless the atom wraps (then into scratch)
+    template <typename Fn>
+    static size_t forEachAtomMessage(lv2_ringbuffer_t* rb, std::vector<uint8_t>& scratch, Fn&& fn) {
+        size_t count = 0, total;
+        while (rb) {
+            const uint8_t* msg = lv2_ringbuffer_peek_msg(rb, scratch.data(), scratch.size(), &total);
+            if (!total) break;
+            if (msg) {
+                fn((const LV2_Atom*)msg);
+                ++count;
+            }
+            lv2_ringbuffer_release_msg(rb, total);
+        }
+        return count;
+    }
+
     // State management
     bool saveState(const std::string& filePath) {
         if (!instance_ || !plugin_) return false;
         
         LilvState* state = lilv_state_new_from_instance(plugin_, instance_,
-                                                        &um_, &unm_, nullptr, nullptr,
-                                                        nullptr, set_port_value, this,
+                                                        &um_, nullptr, nullptr, nullptr,
+                                                        nullptr, get_port_value, this,
                                                         0, nullptr);
         if (!state) return false;
         
-        int result = lilv_state_save(world_, &um_, &unm_, state, filePath.c_str(), nullptr, nullptr);
+        // lilv wants the target directory and file name separately
+        const size_t slash = filePath.find_last_of('/');
+        const std::string dir = slash == std::string::npos ? "." : filePath.substr(0, slash);
+        const std::string file = slash == std::string::npos ? filePath : filePath.substr(slash + 1);
+        int result = lilv_state_save(world_, &um_, &unm_, state, nullptr,
+                                     dir.c_str(), file.c_str());
         lilv_state_free(state);
         
         return result == 0;
     }
 
+    // Safe next to process(): a plugin declaring state:threadSafeRestore
+    // restores concurrently and its control values land at the start of the
+    // next cycle, any other plugin is left out of the cycles restore() takes
+    // (process() outputs silence meanwhile)
     bool loadState(const std::string& filePath) {
         if (!instance_) return false;
         
-        LilvState* state = lilv_state_new_from_file(world_, &um_, filePath.c_str());
+        LilvState* state = lilv_state_new_from_file(world_, &um_, nullptr, filePath.c_str());
         if (!state) return false;
         
-        LV2_Feature* feats[] = { &features_.um_f, &features_.unm_f,
-                                &features_.map_path_feature,
-                                &features_.make_path_feature,
-                                &features_.free_path_feature,
-                                nullptr };
-        
-        lilv_state_restore(state, instance_, set_port_value, this, 0, feats);
+        restore_state(state);
         lilv_state_free(state);
         
         return true;
     }
 
+    // loadState() for a state the caller keeps, e.g. a preset parsed once
+    // and applied many times
+    bool restoreState(const LilvState* state) {
+        if (!instance_ || !state) return false;
+        restore_state(state);
+        return true;
+    }
+
+    // True once after restored control values reached the plugin, for a
+    // UI to read them back
+    bool takeRestoredValues() {
+        return values_restored_.exchange(false, std::memory_order_acq_rel);
+    }
+
+    // saveState()/loadState() as jobs on the state thread, done(ok) is
+    // called there (false as well for a job skipped because the plugin was
+    // closed first). Capture never stops the audio, save() may run next to
+    // run(). Jobs use the lilv world: leave it alone until they finished.
+    void saveStateAsync(const std::string& filePath, std::function<void(bool)> done = nullptr) {
+        state_thread().post([this, guard = state_guard_, filePath, done] {
+            bool ok = false;
+            guard->run([&] { ok = saveState(filePath); });
+            if (done) done(ok);
+        });
+    }
+
+    void loadStateAsync(const std::string& filePath, std::function<void(bool)> done = nullptr) {
+        state_thread().post([this, guard = state_guard_, filePath, done] {
+            bool ok = false;
+            guard->run([&] { ok = loadState(filePath); });
+            if (done) done(ok);
+        });
+    }
+
+    // Run the async jobs on a thread shared with other plugins (the graph
+    // does), before the first of them. Otherwise the plugin starts its own.
+    void setStateThread(LV2StateThread* thread) { state_thread_ = thread; }
+
+    // Block until the state jobs posted so far have finished
+    void waitState() {
+        if (state_thread_) state_thread_->wait();
+    }
+
+    // The plugin declares state:threadSafeRestore
+    bool hasThreadSafeRestore() const { return thread_safe_restore_; }
+
 private:
     // ========== URID Mapping ==========
     struct {
@@ -560,13 +895,16 @@ private:
         LV2_URID atom_Double;
         LV2_URID midi_Event;
         LV2_URID buf_maxBlock;
+        LV2_URID buf_minBlock;
         LV2_URID atom_Path;
         LV2_URID patch_Get;
         LV2_URID patch_Set;
         LV2_URID patch_property;
         LV2_URID patch_value;
+        LV2_URID patch_subject;
         LV2_URID atom_Blank;
         LV2_URID atom_Chunk;
+        LV2_URID atom_URID;
         LV2_URID param_sampleRate;
     } urids_;
 
@@ -581,39 +919,26 @@ private:
         urids_.atom_Double = map_uri(LV2_ATOM__Double);
         urids_.midi_Event = map_uri(LV2_MIDI__MidiEvent);
         urids_.buf_maxBlock = map_uri(LV2_BUF_SIZE__maxBlockLength);
+        urids_.buf_minBlock = map_uri(LV2_BUF_SIZE__minBlockLength);
         urids_.atom_Path = map_uri(LV2_ATOM__Path);
         urids_.patch_Get = map_uri(LV2_PATCH__Get);
         urids_.patch_Set = map_uri(LV2_PATCH__Set);
         urids_.patch_property = map_uri(LV2_PATCH__property);
         urids_.patch_value = map_uri(LV2_PATCH__value);
+        urids_.patch_subject = map_uri(LV2_PATCH__subject);
+        urids_.atom_URID = map_uri(LV2_ATOM__URID);
         urids_.param_sampleRate = map_uri(LV2_PARAMETERS__sampleRate);
     }
 
-    static LV2_URID map_uri(LV2_URID_Map_Handle h, const char* uri) {
-        auto* self = static_cast<LV2Plugin*>(h);
-        auto it = self->urid_map_.find(uri);
-        if (it != self->urid_map_.end()) return it->second;
-        
-        LV2_URID id = self->urid_map_.size() + 1;
-        self->urid_map_[uri] = id;
-        self->urid_unmap_[id] = uri;
-        return id;
-    }
-
-    static const char* unmap_uri(LV2_URID_Unmap_Handle h, LV2_URID urid) {
-        auto* self = static_cast<LV2Plugin*>(h);
-        auto it = self->urid_unmap_.find(urid);
-        if (it == self->urid_unmap_.end()) return nullptr;
-        return it->second.c_str();
+    // All instances share the process wide table
+    static LV2_URID map_uri(LV2_URID_Map_Handle, const char* uri) {
+        return LV2URIDMap::instance().map(uri);
     }
 
     LV2_URID map_uri(const char* uri) {
-        return map_uri((LV2_URID_Map_Handle)this, uri);
+        return LV2URIDMap::instance().map(uri);
     }
 
-    std::unordered_map<std::string, LV2_URID> urid_map_;
-    std::unordered_map<LV2_URID, std::string> urid_unmap_;
-
     LV2_URID_Map um_;
     LV2_URID_Unmap unm_;
 
@@ -625,6 +950,8 @@ private:
         LV2_Feature make_path_feature;
         LV2_Feature free_path_feature;
         LV2_Feature bbl_feature;
+        LV2_Feature fbl_feature;        // offered in fixed block mode
+        LV2_Feature p2bl_feature;
     } features_;
 
     static char* make_path_func(LV2_State_Make_Path_Handle, const char* path) {
@@ -640,10 +967,10 @@ private:
     }
 
     void init_features() {
-        um_.handle = this;
-        um_.map = map_uri;
-        unm_.handle = this;
-        unm_.unmap = unmap_uri;
+        um_.handle = &LV2URIDMap::instance();
+        um_.map = LV2URIDMap::mapCallback;
+        unm_.handle = &LV2URIDMap::instance();
+        unm_.unmap = LV2URIDMap::unmapCallback;
 
         map_path_.handle = nullptr;
         map_path_.abstract_path = map_path_func;
@@ -654,6 +981,10 @@ private:
 
         features_.bbl_feature.URI = LV2_BUF_SIZE__boundedBlockLength;
         features_.bbl_feature.data = nullptr;
+        features_.fbl_feature.URI = LV2_BUF_SIZE__fixedBlockLength;
+        features_.fbl_feature.data = nullptr;
+        features_.p2bl_feature.URI = LV2_BUF_SIZE__powerOf2BlockLength;
+        features_.p2bl_feature.data = nullptr;
 
         features_.um_f.URI = LV2_URID__map;
         features_.um_f.data = &um_;
@@ -670,10 +1001,7 @@ private:
         features_.free_path_feature.URI = LV2_STATE__freePath;
         features_.free_path_feature.data = &free_path_;
 
-        host_worker_.schedule.handle = &host_worker_;
-        host_worker_.schedule.schedule_work = host_schedule_work;
-        host_worker_.feature.URI = LV2_WORKER__schedule;
-        host_worker_.feature.data = &host_worker_.schedule;
+        init_worker_features(host_worker_, restore_worker_);
     }
 
     LV2_State_Map_Path map_path_;
@@ -681,18 +1009,87 @@ private:
     LV2_State_Free_Path free_path_;
 
     static void set_port_value(const char* port_symbol, void* user_data,
-                               const void* value, uint32_t size, uint32_t type) {
+                               const void* value, uint32_t size, uint32_t /*type*/) {
         auto* self = static_cast<LV2Plugin*>(user_data);
-        for (auto& p : self->ports_) {
-            const LilvNode* sym = lilv_port_get_symbol(self->plugin_, p.lilv_port);
-            if (sym && std::string(lilv_node_as_string(sym)) == port_symbol) {
-                if (p.is_control && size == sizeof(float)) {
-                    p.control = *(const float*)value;
-                    lilv_instance_connect_port(self->instance_, p.index, &p.control);
-                }
-                break;
+        const uint32_t i = self->find_port(port_symbol);
+        if (i == UINT32_MAX || size != sizeof(float)) return;
+        const Port& p = self->ports_[i];
+        if (!p.is_control || !p.is_input) return;
+        self->restoring_->values.emplace_back(i, *(const float*)value);
+    }
+
+    // Port values are collected and handed over in one piece, properties go
+    // through the plugin's restore() with the restore worker, on every copy.
+    // A state without properties never needs to stop the audio.
+    void restore_state(const LilvState* state) {
+        auto snap = std::make_unique<LV2PortSnapshot>();
+        restoring_ = snap.get();
+
+        if (lilv_state_get_num_properties(state) == 0) {
+            lilv_state_emit_port_values(state, set_port_value, this);
+            port_swap_.publish(std::move(snap));
+            restoring_ = nullptr;
+            return;
+        }
+
+        LV2_Feature safe_f { LV2_STATE__threadSafeRestore, nullptr };
+        const LV2_Feature* feats[] = { &features_.um_f, &features_.unm_f,
+                                       &features_.map_path_feature,
+                                       &features_.make_path_feature,
+                                       &features_.free_path_feature,
+                                       nullptr, nullptr, nullptr };
+        size_t nfeats = 5;
+        const size_t worker_slot = nfeats;
+        if (restore_worker_.iface) feats[nfeats++] = &restore_worker_.feature;
+        if (thread_safe_restore_) feats[nfeats++] = &safe_f;
+
+        // the copies share the port values, only the first sets them. Each
+        // instance's work lock is held across its whole restore(), the worker
+        // thread can't run a request the last run() queued in the middle of it
+        const auto restore = [&] {
+            {
+                std::lock_guard<std::mutex> lock(work_lock_);
+                lilv_state_restore(state, instance_, set_port_value, this, 0, feats);
+            }
+            for (auto& c : copies_) {
+                if (restore_worker_.iface) feats[worker_slot] = &c->restore_worker.feature;
+                std::lock_guard<std::mutex> lock(c->work_lock);
+                lilv_state_restore(state, c->instance, nullptr, nullptr, 0, feats);
             }
+        };
+
+        if (thread_safe_restore_) {
+            restore();
+            port_swap_.publish(std::move(snap));
+        } else {
+            state_pause_.pause();
+            restore();
+            for (const auto& v : snap->values) control_values_[v.first] = v.second;
+            values_restored_.store(true, std::memory_order_release);
+            state_pause_.resume();
+        }
+        restoring_ = nullptr;
+    }
+
+    LV2StateThread& state_thread() {
+        if (!state_thread_) {
+            own_state_thread_ = std::make_unique<LV2StateThread>();
+            state_thread_ = own_state_thread_.get();
         }
+        return *state_thread_;
+    }
+
+    static const void* get_port_value(const char* port_symbol, void* user_data,
+                                      uint32_t* size, uint32_t* type) {
+        auto* self = static_cast<LV2Plugin*>(user_data);
+        const uint32_t i = self->find_port(port_symbol);
+        if (i != UINT32_MAX && self->ports_[i].is_control && self->ports_[i].is_input) {
+            *size = sizeof(float);
+            *type = self->urids_.atom_Float;
+            return &self->control_values_[i];
+        }
+        *size = *type = 0;
+        return nullptr;
     }
 
     // ========== Feature Support Checking ==========
@@ -739,27 +1136,34 @@ private:
     bool init_ports() {
         uint32_t n = lilv_plugin_get_num_ports(plugin_);
         ports_.reserve(n);
+        port_meta_.reserve(n);
+        tables_.clear();
+        // sized once, controls and the plugin keep pointers into it
+        control_values_.assign(n, 0.0f);
+        ranges_.assign(n, ControlRange{});
 
         LilvNode* midi_event = lilv_new_uri(world_, LV2_MIDI__MidiEvent);
 
         for (uint32_t i = 0; i < n; ++i) {
             const LilvPort* lp = lilv_plugin_get_port_by_index(plugin_, i);
             Port p;
+            PortMeta meta;
             p.index = i;
-            p.lilv_port = lp;
+            meta.lilv_port = lp;
+            const LilvNode* sym = lilv_port_get_symbol(plugin_, lp);
+            if (sym) meta.symbol = lilv_node_as_string(sym);
             p.is_audio = lilv_port_is_a(plugin_, lp, audio_class_);
             p.is_control = lilv_port_is_a(plugin_, lp, control_class_);
             p.is_atom = lilv_port_is_a(plugin_, lp, atom_class_);
             p.is_input = lilv_port_is_a(plugin_, lp, input_class_);
             p.is_midi = lilv_port_supports_event(plugin_, lp, midi_event);
-            p.control = 0.0f;
             p.defvalue = 0.0f;
             p.atom = nullptr;
             p.atom_state = nullptr;
 
             // Allocate and initialize atom ports
             if (p.is_atom) {
-                p.atom_buf_size = required_atom_size_;
+                p.atom_buf_size = p.is_midi ? midi_buffer_size() : required_atom_size_;
                 p.atom = (LV2_Atom_Sequence*)aligned_alloc(64, p.atom_buf_size);
                 memset(p.atom, 0, p.atom_buf_size);
                 p.atom->atom.type = urids_.atom_Sequence;
@@ -772,50 +1176,481 @@ private:
                     p.atom->atom.size = 0;
                 }
 
-                p.atom_state = new AtomState();
-            }
+                // a MIDI port's UI ring holds two full blocks of events
+                p.atom_state = p.is_midi
+                    ? new AtomState(std::max<size_t>(16384, 2 * p.atom_buf_size))
+                    : new AtomState();
 
-            // Extract default values for control inputs
-            if (p.is_control && p.is_input) {
-                LilvNode *pdflt, *pmin, *pmax;
-                lilv_port_get_range(plugin_, lp, &pdflt, &pmin, &pmax);
-                if (pmin) lilv_node_free(pmin);
-                if (pmax) lilv_node_free(pmax);
-                if (pdflt) {
-                    p.defvalue = lilv_node_as_float(pdflt);
-                    lilv_node_free(pdflt);
+                // a split block gives the plugin one slice per sub-block
+                if (p.is_input) {
+                    p.atom_slice = (LV2_Atom_Sequence*)aligned_alloc(64, p.atom_buf_size);
+                    memset(p.atom_slice, 0, p.atom_buf_size);
                 }
-                p.control = p.defvalue;
-            }
 
-            ports_.push_back(p);
+                // MIDI the backend stages for, or takes from, a process() call
+                if (p.is_midi) {
+                    p.stage_size = midi_stage_size();
+                    p.midi_stage = (LV2_Atom_Sequence*)aligned_alloc(64, p.stage_size);
+                    memset(p.midi_stage, 0, p.stage_size);
+                    reset_sequence(p.midi_stage);
+                }
+            }
 
             // Create PluginControl instance for control/atom ports
+            PluginControl* control = nullptr;
             if (p.is_control || p.is_atom) {
-                PluginControl* control = PluginControl::create(world_, plugin_, lp,
-                                                                audio_class_, control_class_, atom_class_);
+                control = PluginControl::create(world_, plugin_, lp,
+                                                audio_class_, control_class_, atom_class_);
+                if (control && control->getType() == PluginControl::Type::AtomPort)
+                    static_cast<AtomPortControl*>(control)->attachAtomState(p.atom_state);
                 if (control) controls_.push_back(control);
             }
+
+            // the control's range goes into ranges_, setValue(), queueValue()
+            // and the control itself all clamp with that entry
+            if (p.is_control) {
+                ranges_[i] = control ? control->getRange() : ControlRange::read(plugin_, lp);
+                if (control) {
+                    control->bind(&control_values_[i], &ranges_[i]);
+                    p.is_trigger = p.is_input && control->getType() == PluginControl::Type::Trigger;
+                }
+                if (p.is_input) {
+                    p.defvalue = ranges_[i].defvalue;
+                    control_values_[i] = p.defvalue;
+                }
+            }
+
+            tables_.add(p);
+            ports_.push_back(p);
+            port_meta_.push_back(std::move(meta));
         }
 
         lilv_node_free(midi_event);
+        scratch_.assign(block_length_, 0.0f);
+        latency_port_ = lilv_plugin_has_latency(plugin_)
+                      ? lilv_plugin_get_latency_port_index(plugin_) : UINT32_MAX;
+        if (latency_port_ >= n || !ports_[latency_port_].is_control) latency_port_ = UINT32_MAX;
+
+        // Hashed lookups, the keys view into port_meta_ which is not
+        // touched again until closePlugin() clears both
+        symbol_index_.clear();
+        symbol_index_.reserve(n);
+        control_by_port_.assign(n, nullptr);
+        for (uint32_t i = 0; i < n; ++i)
+            if (!port_meta_[i].symbol.empty()) symbol_index_.emplace(port_meta_[i].symbol, i);
+        for (auto* control : controls_) control_by_port_[control->getPortIndex()] = control;
+
+        // control_values_ stays put from here on, the automation writes into it
+        automation_.init(n, &stats_);
+        for (uint32_t i : tables_.control_in) automation_.bind(i, &control_values_[i]);
+        control_queue_ = automation_.addQueue();
         return true;
     }
 
+    // Port index by symbol, UINT32_MAX when unknown
+    uint32_t find_port(const char* symbol) const {
+        if (!symbol) return UINT32_MAX;
+        auto it = symbol_index_.find(symbol);
+        return it != symbol_index_.end() ? it->second : UINT32_MAX;
+    }
+
+    ControlHandle control_handle(uint32_t i) const {
+        if (i >= ports_.size() || !ports_[i].is_control || !ports_[i].is_input) return {};
+        return ControlHandle{ i };
+    }
+
+    // Hot per-port data, touched by process()
     struct Port {
         uint32_t index = 0;
-        const LilvPort* lilv_port = nullptr;
         bool is_audio = false, is_input = false, is_control = false;
-        bool is_atom = false, is_midi = false;
+        bool is_atom = false, is_midi = false, is_trigger = false;
 
-        float control = 0.0f, defvalue = 0.0f;
+        float defvalue = 0.0f;                 // value lives in control_values_
+        void* connected = nullptr;      // last buffer given to connect_port
         LV2_Atom_Sequence* atom = nullptr;
+        LV2_Atom_Sequence* atom_slice = nullptr;    // inputs: one sub-block's events
+        LV2_Atom_Sequence* midi_stage = nullptr;    // MIDI: writeMidiInput(), forEachMidiOutput()
+        uint32_t stage_size = 0;
         uint32_t atom_buf_size = 8192;
         AtomState* atom_state = nullptr;
     };
 
+    // Cold per-port data, indexed like ports_, never touched in RT
+    struct PortMeta {
+        const LilvPort* lilv_port = nullptr;
+        std::string symbol;
+    };
+
+public:
+    // Port indices by role, built once in init_ports() so every RT
+    // pass only visits the ports it works on
+    struct PortTables {
+        std::vector<uint32_t> audio_in, audio_out;
+        std::vector<uint32_t> midi_in, midi_out;
+        std::vector<uint32_t> atom_in, atom_out;
+        std::vector<uint32_t> control_in, control_out;
+        std::vector<uint32_t> trigger_in;
+
+        void add(const Port& p) {
+            const uint32_t i = p.index;
+            if (p.is_audio) (p.is_input ? audio_in : audio_out).push_back(i);
+            if (p.is_atom) {
+                (p.is_input ? atom_in : atom_out).push_back(i);
+                if (p.is_midi) (p.is_input ? midi_in : midi_out).push_back(i);
+            }
+            if (p.is_control) (p.is_input ? control_in : control_out).push_back(i);
+            if (p.is_trigger) trigger_in.push_back(i);
+        }
+
+        void clear() {
+            audio_in.clear(); audio_out.clear();
+            midi_in.clear(); midi_out.clear();
+            atom_in.clear(); atom_out.clear();
+            control_in.clear(); control_out.clear();
+            trigger_in.clear();
+        }
+    };
+
+    // Port indices of one instance, valid after initialize()
+    const PortTables& getPortTables() const { return tables_; }
+
+    // patch:Set subject and property URID in one key, 0 for any other
+    // atom. UIs use it to drop patch:Set messages a newer one overwrote.
+    uint64_t patchSetKey(const LV2_Atom* atom) const {
+        if (atom->type != urids_.atom_Object && atom->type != urids_.atom_Blank)
+            return 0;
+        const LV2_Atom_Object* obj = (const LV2_Atom_Object*)atom;
+        if (obj->body.otype != urids_.patch_Set) return 0;
+
+        const LV2_Atom* subject = nullptr;
+        const LV2_Atom* property = nullptr;
+        lv2_atom_object_get(obj, urids_.patch_subject, &subject,
+                                 urids_.patch_property, &property, 0);
+        if (!property || property->type != urids_.atom_URID) return 0;
+        const uint64_t s = (subject && subject->type == urids_.atom_URID)
+                         ? ((const LV2_Atom_URID*)subject)->body : 0;
+        return s << 32 | ((const LV2_Atom_URID*)property)->body;
+    }
+
+private:
+
+    // RT: move every queued UI message into the input sequence at frame 0,
+    // messages that do not fit this cycle stay queued for the next one
+    void drain_ui_messages(Port& p) {
+        lv2_ringbuffer_t* rb = p.atom_state->ui_to_dsp;
+        const uint32_t capacity = p.atom_buf_size - sizeof(LV2_Atom);
+        LV2_Atom hdr;
+        while (lv2_ringbuffer_read_space(rb) >= sizeof(LV2_Atom)) {
+            lv2_ringbuffer_peek(rb, (char*)&hdr, sizeof(LV2_Atom));
+            const uint32_t total = sizeof(LV2_Atom) + hdr.size;
+            const uint32_t needed = lv2_atom_pad_size(sizeof(LV2_Atom_Event) + hdr.size);
+            if (needed > capacity - sizeof(LV2_Atom_Sequence_Body)) {
+                // Would never fit the port buffer
+                lv2_ringbuffer_release_msg(rb, total);
+                continue;
+            }
+            if (p.atom->atom.size + needed > capacity) break;
+            LV2_Atom_Event* ev = lv2_atom_sequence_end(&p.atom->body, p.atom->atom.size);
+            ev->time.frames = 0;
+            lv2_ringbuffer_peek(rb, (char*)&ev->body, total);
+            lv2_ringbuffer_release_msg(rb, total);
+            p.atom->atom.size += needed;
+        }
+    }
+
+    // RT: an empty sequence
+    void reset_sequence(LV2_Atom_Sequence* seq) {
+        seq->atom.type = urids_.atom_Sequence;
+        seq->atom.size = sizeof(LV2_Atom_Sequence_Body);
+    }
+
+    // RT: one event at the end of seq, whole or not at all
+    static bool append_event(LV2_Atom_Sequence* seq, uint32_t capacity, int64_t frames,
+                             uint32_t type, uint32_t size, const void* body) {
+        const uint32_t needed = lv2_atom_pad_size(sizeof(LV2_Atom_Event) + size);
+        if (seq->atom.size + needed > capacity) return false;
+        LV2_Atom_Event* ev = lv2_atom_sequence_end(&seq->body, seq->atom.size);
+        ev->time.frames = frames;
+        ev->body.size = size;
+        ev->body.type = type;
+        memcpy(ev + 1, body, size);
+        seq->atom.size += needed;
+        return true;
+    }
+
+    // RT: the staged MIDI due in this block goes behind the UI messages,
+    // in order; later events move to the front of the stage
+    void merge_midi_input(Port& p, uint32_t frames) {
+        LV2_Atom_Sequence* stage = p.midi_stage;
+        const uint32_t end = stage->atom.size;
+        if (end <= sizeof(LV2_Atom_Sequence_Body)) return;
+        uint8_t* base = (uint8_t*)&stage->body;
+        const uint32_t capacity = p.atom_buf_size - sizeof(LV2_Atom);
+        const int64_t due = block_pos_ + frames;
+        int64_t last = 0;
+        uint32_t kept = sizeof(LV2_Atom_Sequence_Body), dropped = 0;
+        for (uint32_t off = kept; off < end;) {
+            LV2_Atom_Event* ev = (LV2_Atom_Event*)(base + off);
+            const uint32_t size = lv2_atom_pad_size(sizeof(LV2_Atom_Event) + ev->body.size);
+            if (ev->time.frames < due) {
+                last = std::max(last, ev->time.frames - block_pos_);
+                if (!append_event(p.atom, capacity, last, ev->body.type, ev->body.size, ev + 1))
+                    ++dropped;
+            } else {
+                if (off != kept) memmove(base + kept, ev, size);
+                kept += size;
+            }
+            off += size;
+        }
+        stage->atom.size = kept;
+        if (dropped) LV2HostStats::inc(stats_.midi_in_dropped, dropped);
+    }
+
+    // RT: what a call left staged counts from the start of the next one.
+    // Events of a fixed block the FIFO started filling keep their frame in
+    // it (negative), a paused call moves the rest to the block start.
+    void age_midi_input(uint32_t numFrames) {
+        const int64_t start = -(int64_t)block_adapter_.fill();
+        for (uint32_t i : tables_.midi_in) {
+            LV2_ATOM_SEQUENCE_FOREACH(ports_[i].midi_stage, ev)
+                ev->time.frames = std::max<int64_t>(start, ev->time.frames - numFrames);
+        }
+    }
+
+    // RT: drop the MIDI output the last call of frames handed out, the
+    // events due later (fixed block length) move to the front
+    void retire_midi_output(uint32_t frames) {
+        for (uint32_t i : tables_.midi_out) {
+            LV2_Atom_Sequence* stage = ports_[i].midi_stage;
+            const uint32_t end = stage->atom.size;
+            uint8_t* base = (uint8_t*)&stage->body;
+            uint32_t kept = sizeof(LV2_Atom_Sequence_Body);
+            for (uint32_t off = kept; off < end;) {
+                LV2_Atom_Event* ev = (LV2_Atom_Event*)(base + off);
+                const uint32_t size = lv2_atom_pad_size(sizeof(LV2_Atom_Event) + ev->body.size);
+                if (ev->time.frames >= frames) {
+                    ev->time.frames -= frames;
+                    if (off != kept) memmove(base + kept, ev, size);
+                    kept += size;
+                }
+                off += size;
+            }
+            stage->atom.size = kept;
+        }
+    }
+
+    // MIDI ports hold one block of events at midi_event_density_, each a
+    // 16 byte event header plus a short message padded to 8 bytes, and at
+    // least what the plugin asks for with rsz:minimumSize
+    uint32_t midi_buffer_size() const {
+        return midi_events_size(std::max(block_length_, max_block_length_));
+    }
+
+    // The stages hold a call beyond what the plugin works on: at a fixed
+    // block length a full FIFO plus a call in, a delayed block plus a call
+    // out
+    uint32_t midi_stage_size() const {
+        const uint32_t call = std::max(block_length_, max_block_length_);
+        return fixed_block_ ? midi_events_size(2 * block_length_ + call)
+                            : midi_buffer_size();
+    }
+
+    uint32_t midi_events_size(size_t frames) const {
+        const size_t per_event = sizeof(LV2_Atom_Event) + 8;
+        const size_t events = (size_t)(frames * std::max(0.0f, midi_event_density_)) + 1;
+        const size_t bytes = next_power_of_two(sizeof(LV2_Atom_Sequence) + events * per_event);
+        return std::max<uint32_t>(required_atom_size_, bytes);
+    }
+
+    // RT: one plugin block of at most block_length_ frames, run() split
+    // where automation is due
+    void process_block(float* const* inputs, float* const* outputs,
+                       uint32_t channels, uint32_t numFrames, LV2CycleRecord* cycle) {
+        LV2HostStats::inc(stats_.cycles);
+        if (denormal_protection_) LV2Denormals::protect();
+        const uint32_t num_out = tables_.audio_out.size() * instance_count_;
+
+        // --- Step A: Drain queued UI→DSP atom messages and staged MIDI ---
+        for (uint32_t i : tables_.atom_in) {
+            Port& p = ports_[i];
+            reset_sequence(p.atom);
+            drain_ui_messages(p);
+            if (p.midi_stage) merge_midi_input(p, numFrames);
+            if (cycle) cycle->atom_in_bytes += p.atom->atom.size;
+        }
+
+        // --- Step B: Run plugin, sampling the denormal flags around it ---
+        const bool quiet = idle_gate_.enabled() && idle_quiet(inputs, channels, numFrames);
+        if (idle_gate_.skip(quiet)) {
+            // the automation clock keeps going, its changes wake the plugin
+            automation_.process(numFrames, [](uint32_t, uint32_t) {});
+            LV2HostStats::inc(stats_.idle_cycles);
+            if (cycle) cycle->flags |= LV2CycleRecord::kIdle;
+            for (uint32_t c = 0; c < std::min(num_out, channels); ++c)
+                memset(outputs[c], 0, numFrames * sizeof(float));
+        } else {
+            const uint64_t run_start = cycle ? LV2PerfMonitor::now() : 0;
+            LV2Denormals::takeFlags();
+            automation_.process(numFrames, [&](uint32_t offset, uint32_t frames) {
+                run_slice(inputs, outputs, channels, offset, frames, numFrames, cycle);
+            });
+            if (LV2Denormals::takeFlags()) {
+                LV2HostStats::inc(stats_.denormal_cycles);
+                if (cycle) cycle->flags |= LV2CycleRecord::kDenormal;
+            }
+            if (cycle) cycle->run_ns += (uint32_t)(LV2PerfMonitor::now() - run_start);
+            if (quiet)
+                idle_gate_.update(idle_gate_.silent(outputs, std::min(num_out, channels), numFrames),
+                                  numFrames, getLatency());
+            else
+                idle_gate_.update(false, numFrames);
+        }
+
+        // --- Step C: Deliver worker responses ---
+        if (host_worker_.iface) {
+            uint32_t msgs = deliver_worker_responses(host_worker_) +
+                            deliver_worker_responses(restore_worker_);
+            for (auto& c : copies_)
+                msgs += deliver_worker_responses(c->worker) +
+                        deliver_worker_responses(c->restore_worker);
+            if (cycle) cycle->worker_msgs += msgs;
+        }
+
+        // Input sequences are empty until the next block drains into them
+        for (uint32_t i : tables_.atom_in) ports_[i].atom->atom.size = 0;
+
+        // --- Step D: Pass through channels the plugin has no output for ---
+        for (uint32_t c = num_out; c < channels; ++c) {
+            if (outputs[c] != inputs[c])
+                memcpy(outputs[c], inputs[c], numFrames * sizeof(float));
+        }
+    }
+
+    // RT: run() on [offset, offset + frames) of a block of numFrames. Audio
+    // ports only reconnect when the buffers moved, a split block gives
+    // every sub-block its slice of the input sequences.
+    void run_slice(float* const* inputs, float* const* outputs, uint32_t channels,
+                   uint32_t offset, uint32_t frames, uint32_t numFrames, LV2CycleRecord* cycle) {
+        const uint32_t num_in = tables_.audio_in.size();
+        const uint32_t num_out = tables_.audio_out.size();
+        for (uint32_t k = 0; k < num_in; ++k)
+            connect_audio_port(ports_[tables_.audio_in[k]], inputs[k % channels] + offset);
+        for (uint32_t k = 0; k < num_out; ++k)
+            connect_audio_port(ports_[tables_.audio_out[k]],
+                               (k < channels ? outputs[k] : scratch_.data()) + offset);
+
+        const bool split = frames != numFrames;
+        const uint32_t end = offset + frames < numFrames ? offset + frames : UINT32_MAX;
+        for (uint32_t i : tables_.atom_in) {
+            Port& p = ports_[i];
+            if (split)
+                lv2_sequence_slice(p.atom, p.atom_slice, p.atom_buf_size - sizeof(LV2_Atom),
+                                   offset, end);
+            connect_atom_input(p, split ? p.atom_slice : p.atom);
+        }
+        // Output sequences start empty with the whole buffer as capacity
+        for (uint32_t i : tables_.atom_out) {
+            Port& p = ports_[i];
+            p.atom->atom.type = 0;
+            p.atom->atom.size = p.atom_buf_size - sizeof(LV2_Atom);
+        }
+
+        lilv_instance_run(instance_, frames);
+        for (uint32_t j = 1; j < instance_count_; ++j)
+            run_copy(*copies_[j - 1], j, inputs, outputs, channels, offset, frames, split);
+
+        // Triggers fire for exactly one run
+        for (uint32_t i : tables_.trigger_in) control_values_[i] = ports_[i].defvalue;
+
+        // Copy output atoms to the DSP→UI ringbuffers, MIDI to the stage
+        // at the frame in the process() call its audio plays out
+        for (uint32_t i : tables_.atom_out) {
+            Port& p = ports_[i];
+            if (!p.atom->atom.type) continue;
+            if (cycle) cycle->atom_out_bytes += p.atom->atom.size;
+            const int64_t base = block_pos_ + block_adapter_.latency() + offset;
+            LV2_ATOM_SEQUENCE_FOREACH(p.atom, ev) {
+                if (ev->body.size == 0) break;
+                lv2_ringbuffer_write_msg(p.atom_state->dsp_to_ui, &ev->body,
+                    sizeof(LV2_Atom), LV2_ATOM_BODY(&ev->body), ev->body.size);
+                if (p.midi_stage && ev->body.type == urids_.midi_Event &&
+                    !append_event(p.midi_stage, p.stage_size - sizeof(LV2_Atom),
+                                  base + ev->time.frames, ev->body.type, ev->body.size,
+                                  LV2_ATOM_BODY(&ev->body)))
+                    LV2HostStats::inc(stats_.midi_out_dropped);
+            }
+        }
+    }
+
+    // RT: split blocks move atom inputs to their slice, the next whole
+    // block moves them back
+    void connect_atom_input(Port& p, LV2_Atom_Sequence* seq) {
+        if (seq == p.connected) return;
+        lilv_instance_connect_port(instance_, p.index, seq);
+        p.connected = seq;
+    }
+
+    // RT: silent inputs, no atom input, worker response or control change
+    // since the last block. Updates the control snapshot.
+    bool idle_quiet(float* const* inputs, uint32_t channels, uint32_t numFrames) {
+        bool quiet = true;
+        for (size_t k = 0; k < idle_controls_.size(); ++k) {
+            const float v = control_values_[tables_.control_in[k]];
+            if (v != idle_controls_[k]) {
+                idle_controls_[k] = v;
+                quiet = false;
+            }
+        }
+        if (!quiet) return false;
+        for (uint32_t i : tables_.atom_in)
+            if (ports_[i].atom->atom.size > sizeof(LV2_Atom_Sequence_Body)) return false;
+        if (host_worker_.responses && lv2_ringbuffer_read_space(host_worker_.responses))
+            return false;
+        if (restore_worker_.responses && lv2_ringbuffer_read_space(restore_worker_.responses))
+            return false;
+        for (auto& c : copies_) {
+            if (c->worker.responses && lv2_ringbuffer_read_space(c->worker.responses)) return false;
+            if (c->restore_worker.responses && lv2_ringbuffer_read_space(c->restore_worker.responses))
+                return false;
+        }
+        const uint32_t used = std::min<uint32_t>(tables_.audio_in.size() * instance_count_, channels);
+        return idle_gate_.silent(inputs, used, numFrames);
+    }
+
+    // RT: connect_port only when the buffer differs from the last one
+    void connect_audio_port(Port& p, void* buf) {
+        if (buf == p.connected) return;
+        lilv_instance_connect_port(instance_, p.index, buf);
+        p.connected = buf;
+        LV2HostStats::inc(stats_.port_reconnects);
+    }
+
+    // ========== Block Length ==========
+    // The plugin runs at max_block_length_ unless it requires a fixed or a
+    // power of two block length, or setFixedBlockLength() asked for one.
+    // A power of two plugin also gets a fixed block, the simplest way to
+    // guarantee it.
+    void configure_block_length() {
+        fixed_block_ = fixed_block_length_ != 0;
+        pow2_block_ = false;
+        LilvNodes* requests = lilv_plugin_get_required_features(plugin_);
+        LILV_FOREACH(nodes, f, requests) {
+            const char* uri = lilv_node_as_uri(lilv_nodes_get(requests, f));
+            if (!strcmp(uri, LV2_BUF_SIZE__fixedBlockLength)) fixed_block_ = true;
+            if (!strcmp(uri, LV2_BUF_SIZE__powerOf2BlockLength)) fixed_block_ = pow2_block_ = true;
+        }
+        lilv_nodes_free(requests);
+        block_length_ = fixed_block_length_ ? fixed_block_length_ : max_block_length_;
+        if (pow2_block_) block_length_ = next_power_of_two(block_length_);
+    }
+
     // ========== Plugin Instantiation ==========
     bool init_instance() {
+        const LV2_Options_Option min_block {
+            LV2_OPTIONS_INSTANCE, 0, urids_.buf_minBlock,
+            sizeof(uint32_t), urids_.atom_Int, &block_length_
+        };
+        const LV2_Options_Option end { LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr };
         LV2_Options_Option options[] = {
             {
                 LV2_OPTIONS_INSTANCE,
@@ -823,9 +1658,10 @@ private:
                 urids_.buf_maxBlock,
                 sizeof(uint32_t),
                 urids_.atom_Int,
-                &max_block_length_
+                &block_length_
             },
-            { LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, nullptr }
+            fixed_block_ ? min_block : end,
+            end
         };
 
         LV2_Feature opt_f { LV2_OPTIONS__options, options };
@@ -833,40 +1669,103 @@ private:
         LV2_Feature* feats[] = { &features_.um_f, &features_.unm_f, &opt_f,
                     &features_.bbl_feature, &features_.map_path_feature,
                     &features_.make_path_feature, &features_.free_path_feature,
-                    &host_worker_.feature, nullptr };
+                    &host_worker_.feature, nullptr, nullptr, nullptr };
+        size_t nfeats = 8;
+        if (fixed_block_) feats[nfeats++] = &features_.fbl_feature;
+        if (pow2_block_) feats[nfeats++] = &features_.p2bl_feature;
 
         if (!checkFeatures(feats)) return false;
 
         instance_ = lilv_plugin_instantiate(plugin_, sample_rate_, feats);
         if (!instance_) return false;
+        start_worker(instance_, host_worker_, restore_worker_, &work_lock_);
 
-        // Setup worker if plugin provides interface
-        const LV2_Worker_Interface* iface = (const LV2_Worker_Interface*)
-            lilv_instance_get_extension_data(instance_, LV2_WORKER__interface);
-
-        if (iface) {
-            host_worker_.iface = iface;
-            host_worker_.dsp_handle = lilv_instance_get_handle(instance_);
-            host_worker_.requests = lv2_ringbuffer_create(8192);
-            host_worker_.responses = lv2_ringbuffer_create(8192);
-            host_worker_.response_buffer.resize(8192);
-            host_worker_.running.store(true);
-            host_worker_.worker_thread = std::thread(worker_thread_func, &host_worker_);
-        }
+        LilvNode* safe_restore = lilv_new_uri(world_, LV2_STATE__threadSafeRestore);
+        thread_safe_restore_ = lilv_plugin_has_feature(plugin_, safe_restore);
+        lilv_node_free(safe_restore);
 
         // Connect control and atom ports
         for (auto& p : ports_) {
             if (p.is_audio) continue;
             if (p.is_control)
-                lilv_instance_connect_port(instance_, p.index, &p.control);
-            if (p.is_atom)
+                lilv_instance_connect_port(instance_, p.index, &control_values_[p.index]);
+            if (p.is_atom) {
                 lilv_instance_connect_port(instance_, p.index, p.atom);
+                p.connected = p.atom;
+            }
         }
 
         lilv_instance_activate(instance_);
+
+        // the copies get the same features with a worker of their own
+        for (uint32_t j = 1; j < instance_count_; ++j) {
+            auto c = std::make_unique<InstanceCopy>();
+            init_worker_features(c->worker, c->restore_worker);
+            feats[7] = &c->worker.feature;
+            c->instance = lilv_plugin_instantiate(plugin_, sample_rate_, feats);
+            if (!c->instance) return false;
+            start_worker(c->instance, c->worker, c->restore_worker, &c->work_lock);
+            c->controls.assign(ports_.size(), 0.0f);
+            c->connected.assign(tables_.audio_in.size() + tables_.audio_out.size(), nullptr);
+            for (auto& p : ports_) {
+                if (p.is_control)
+                    lilv_instance_connect_port(c->instance, p.index, p.is_input
+                                               ? &control_values_[p.index] : &c->controls[p.index]);
+                if (p.is_atom && p.is_input)
+                    lilv_instance_connect_port(c->instance, p.index, p.atom);
+                if (p.is_atom && !p.is_input) {
+                    auto* seq = (LV2_Atom_Sequence*)aligned_alloc(64, p.atom_buf_size);
+                    memset(seq, 0, p.atom_buf_size);
+                    c->atom_out.push_back(seq);
+                    lilv_instance_connect_port(c->instance, p.index, seq);
+                }
+            }
+            lilv_instance_activate(c->instance);
+            copies_.push_back(std::move(c));
+        }
         return true;
     }
 
+    // Prefault (and pin, as far as RLIMIT_MEMLOCK allows) every buffer
+    // process() touches. mlockall() is left to the application.
+    void lock_rt_buffers() {
+        LV2RTMemory::lock(ports_.data(), ports_.size() * sizeof(Port));
+        LV2RTMemory::lock(scratch_.data(), scratch_.size() * sizeof(float));
+        LV2RTMemory::lock(control_values_.data(), control_values_.size() * sizeof(float));
+        if (control_queue_) LV2RTMemory::lock(control_queue_->ringbuffer());
+        for (auto& p : ports_) {
+            if (p.atom) LV2RTMemory::lock(p.atom, p.atom_buf_size);
+            if (p.atom_slice) LV2RTMemory::lock(p.atom_slice, p.atom_buf_size);
+            if (p.midi_stage) LV2RTMemory::lock(p.midi_stage, p.stage_size);
+            if (p.atom_state) {
+                LV2RTMemory::lock(p.atom_state->ui_to_dsp);
+                LV2RTMemory::lock(p.atom_state->dsp_to_ui);
+            }
+        }
+        if (host_worker_.iface) {
+            LV2RTMemory::lock(host_worker_.requests);
+            LV2RTMemory::lock(host_worker_.responses);
+            LV2RTMemory::lock(host_worker_.response_buffer.data(),
+                              host_worker_.response_buffer.size());
+            LV2RTMemory::lock(restore_worker_.responses);
+            LV2RTMemory::lock(restore_worker_.response_buffer.data(),
+                              restore_worker_.response_buffer.size());
+        }
+        for (auto& c : copies_) {
+            LV2RTMemory::lock(c.get(), sizeof(InstanceCopy));
+            LV2RTMemory::lock(c->controls.data(), c->controls.size() * sizeof(float));
+            for (size_t k = 0; k < c->atom_out.size(); ++k)
+                LV2RTMemory::lock(c->atom_out[k], ports_[tables_.atom_out[k]].atom_buf_size);
+            if (!c->worker.iface) continue;
+            LV2RTMemory::lock(c->worker.requests);
+            LV2RTMemory::lock(c->worker.responses);
+            LV2RTMemory::lock(c->worker.response_buffer.data(), c->worker.response_buffer.size());
+            LV2RTMemory::lock(c->restore_worker.responses);
+            LV2RTMemory::lock(c->restore_worker.response_buffer.data(),
+                              c->restore_worker.response_buffer.size());
+        }
+    }
+
     // ========== Worker Thread ==========
     struct LV2HostWorker {
         lv2_ringbuffer_t* requests = nullptr;
@@ -878,111 +1777,228 @@ private:
         LV2_Handle dsp_handle;
 
         std::atomic<bool> running{false};
-        std::atomic<bool> work_pending{false};
         std::thread worker_thread;
+        sem_t wake;                 // posted once per scheduled request
 
-        std::vector<uint8_t> response_buffer;
+        LV2HostStats* stats = nullptr;
+        bool denormal_protection = true;
+        std::mutex* work_lock = nullptr;        // work() never runs twice at once
+        std::vector<uint8_t> request_buffer;    // Worker side scratch
+        std::vector<uint8_t> response_buffer;   // Audio side scratch
     };
 
+    // Worker rings hold two messages of the largest atom the plugin declares
+    // (rsz:minimumSize) or of setWorkerSize(), whichever is larger
+    size_t worker_ring_size() const {
+        const size_t msg = lv2_ringbuffer_msg_pad(LV2_RINGBUFFER_MSG_HEADER +
+                                std::max(worker_size_, required_atom_size_));
+        return next_power_of_two(2 * msg);
+    }
+
     static LV2_Worker_Status host_schedule_work(
         LV2_Worker_Schedule_Handle handle, uint32_t size, const void* data) {
-        
+
         auto* w = (LV2HostWorker*)handle;
-        const size_t total = sizeof(uint32_t) + size;
-        if (lv2_ringbuffer_write_space(w->requests) < total)
+        const uint32_t hdr[2] = { size, 0 };
+        if (!lv2_ringbuffer_write_msg(w->requests, hdr, sizeof(hdr), data, size)) {
+            LV2HostStats::inc(w->stats->worker_no_space);
             return LV2_WORKER_ERR_NO_SPACE;
+        }
 
-        lv2_ringbuffer_write(w->requests, (const char*)&size, sizeof(uint32_t));
-        lv2_ringbuffer_write(w->requests, (const char*)data, size);
-        w->work_pending.store(true, std::memory_order_release);
+        sem_post(&w->wake);
 
         return LV2_WORKER_SUCCESS;
     }
 
     static void worker_thread_func(LV2HostWorker* w) {
+        if (w->denormal_protection) LV2Denormals::protect();
         while (w->running.load()) {
-            if (lv2_ringbuffer_read_space(w->requests) < sizeof(uint32_t)) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            size_t total;
+            const uint8_t* msg = lv2_ringbuffer_peek_msg(w->requests,
+                w->request_buffer.data(), w->request_buffer.size(), &total);
+            if (!msg) {
+                if (total) {
+                    // Can't happen, the scratch is as large as the ring
+                    LV2HostStats::inc(w->stats->worker_dropped);
+                    lv2_ringbuffer_release_msg(w->requests, total);
+                    continue;
+                }
+                // Nothing queued, block until host_schedule_work() posts
+                sem_wait(&w->wake);
                 continue;
             }
 
-            uint32_t size;
-            lv2_ringbuffer_peek(w->requests, (char*)&size, sizeof(uint32_t));
-
-            if (lv2_ringbuffer_read_space(w->requests) < sizeof(uint32_t) + size) {
-                continue;
+            // The request is handed over in place when it does not wrap
+            const uint32_t size = total - LV2_RINGBUFFER_MSG_HEADER;
+            {
+                std::lock_guard<std::mutex> lock(*w->work_lock);
+                w->iface->work(w->dsp_handle, host_respond, w, size,
+                               msg + LV2_RINGBUFFER_MSG_HEADER);
             }
-
-            lv2_ringbuffer_read(w->requests, (char*)&size, sizeof(uint32_t));
-            std::vector<uint8_t> buf(size);
-            lv2_ringbuffer_read(w->requests, (char*)buf.data(), size);
-            w->iface->work(w->dsp_handle, host_respond, w, size, buf.data());
+            lv2_ringbuffer_release_msg(w->requests, total);
         }
     }
 
+    // restore() scheduling: the work runs right away on the restoring
+    // thread, its responses reach run() through a ring of their own.
+    // restore_state() already holds the work lock.
+    static LV2_Worker_Status restore_schedule_work(
+        LV2_Worker_Schedule_Handle handle, uint32_t size, const void* data) {
+
+        auto* w = (LV2HostWorker*)handle;
+        return w->iface->work(w->dsp_handle, host_respond, w, size, data);
+    }
+
     static LV2_Worker_Status host_respond(
         LV2_Worker_Respond_Handle handle, uint32_t size, const void* data) {
-        
-        auto* w = (LV2HostWorker*)handle;
-        const size_t total = sizeof(uint32_t) + size;
 
-        if (lv2_ringbuffer_write_space(w->responses) < total)
+        auto* w = (LV2HostWorker*)handle;
+        const uint32_t hdr[2] = { size, 0 };
+        if (!lv2_ringbuffer_write_msg(w->responses, hdr, sizeof(hdr), data, size)) {
+            LV2HostStats::inc(w->stats->worker_no_space);
             return LV2_WORKER_ERR_NO_SPACE;
-
-        lv2_ringbuffer_write(w->responses, (const char*)&size, sizeof(uint32_t));
-        lv2_ringbuffer_write(w->responses, (const char*)data, size);
+        }
 
         return LV2_WORKER_SUCCESS;
     }
 
-    void deliver_worker_responses() {
-        constexpr size_t kDrainChunk = 256;
-        uint8_t scratch[kDrainChunk];
-        
+    uint32_t deliver_worker_responses(LV2HostWorker& w) {
+        uint32_t delivered = 0;
         while (true) {
-            if (lv2_ringbuffer_read_space(host_worker_.responses) < sizeof(uint32_t)) break;
+            size_t total;
+            // In place, response_buffer only catches messages that wrap
+            const uint8_t* msg = lv2_ringbuffer_peek_msg(w.responses,
+                w.response_buffer.data(), w.response_buffer.size(), &total);
+            if (!total) break;
+            if (msg) {
+                w.iface->work_response(w.dsp_handle, total - LV2_RINGBUFFER_MSG_HEADER,
+                                       msg + LV2_RINGBUFFER_MSG_HEADER);
+                ++delivered;
+            } else {
+                LV2HostStats::inc(w.stats->worker_dropped);
+            }
+            lv2_ringbuffer_release_msg(w.responses, total);
+        }
+        return delivered;
+    }
 
-            uint32_t size;
-            lv2_ringbuffer_peek(host_worker_.responses, (char*)&size, sizeof(uint32_t));
+    static void init_worker_features(LV2HostWorker& w, LV2HostWorker& restore) {
+        w.schedule.handle = &w;
+        w.schedule.schedule_work = host_schedule_work;
+        w.feature.URI = LV2_WORKER__schedule;
+        w.feature.data = &w.schedule;
+        restore.schedule.handle = &restore;
+        restore.schedule.schedule_work = restore_schedule_work;
+        restore.feature.URI = LV2_WORKER__schedule;
+        restore.feature.data = &restore.schedule;
+    }
 
-            if (lv2_ringbuffer_read_space(host_worker_.responses) < sizeof(uint32_t) + size) break;
+    // The worker thread of one instance, when the plugin has a worker
+    // interface. work_lock keeps its work() apart from restore().
+    void start_worker(LilvInstance* instance, LV2HostWorker& w, LV2HostWorker& restore,
+                      std::mutex* work_lock) {
+        const LV2_Worker_Interface* iface = (const LV2_Worker_Interface*)
+            lilv_instance_get_extension_data(instance, LV2_WORKER__interface);
+        if (!iface) return;
+
+        w.iface = iface;
+        w.dsp_handle = lilv_instance_get_handle(instance);
+        const size_t ring_size = worker_ring_size();
+        w.stats = &stats_;
+        w.denormal_protection = denormal_protection_;
+        w.requests = lv2_ringbuffer_create(ring_size);
+        w.responses = lv2_ringbuffer_create(ring_size);
+        w.request_buffer.resize(ring_size);
+        w.response_buffer.resize(ring_size);
+        sem_init(&w.wake, 0, 0);
+        w.running.store(true);
+        w.work_lock = work_lock;
+        w.worker_thread = std::thread(worker_thread_func, &w);
+
+        // work scheduled from restore() runs on the restoring thread
+        restore.iface = iface;
+        restore.dsp_handle = w.dsp_handle;
+        restore.stats = &stats_;
+        restore.responses = lv2_ringbuffer_create(ring_size);
+        restore.response_buffer.resize(ring_size);
+        restore.work_lock = work_lock;
+    }
 
-            lv2_ringbuffer_read(host_worker_.responses, (char*)&size, sizeof(uint32_t));
+    void stop_worker(LV2HostWorker& w, LV2HostWorker& restore) {
+        if (!w.running.exchange(false))
+            return;
 
-            if (size <= host_worker_.response_buffer.size()) {
-                lv2_ringbuffer_read(host_worker_.responses, (char*)host_worker_.response_buffer.data(), size);
-                host_worker_.iface->work_response(host_worker_.dsp_handle, size, host_worker_.response_buffer.data());
-                continue;
-            }
+        sem_post(&w.wake);
+        if (w.worker_thread.joinable())
+            w.worker_thread.join();
+        sem_destroy(&w.wake);
 
-            size_t remaining = size;
-            while (remaining > 0) {
-                const size_t chunk = std::min(remaining, kDrainChunk);
-                lv2_ringbuffer_read(host_worker_.responses, (char*)scratch, chunk);
-                remaining -= chunk;
-            }
+        if (w.requests) {
+            lv2_ringbuffer_free(w.requests);
+            w.requests = nullptr;
         }
-    }
 
-    void stop_worker() {
-        if (!host_worker_.running.exchange(false))
-            return;
+        if (w.responses) {
+            lv2_ringbuffer_free(w.responses);
+            w.responses = nullptr;
+        }
 
-        if (host_worker_.worker_thread.joinable())
-            host_worker_.worker_thread.join();
+        w.iface = nullptr;
+        w.dsp_handle = nullptr;
 
-        if (host_worker_.requests) {
-            lv2_ringbuffer_free(host_worker_.requests);
-            host_worker_.requests = nullptr;
+        if (restore.responses) {
+            lv2_ringbuffer_free(restore.responses);
+            restore.responses = nullptr;
         }
+        restore.iface = nullptr;
+        restore.dsp_handle = nullptr;
+    }
+
+    // ========== Linked copies ==========
+    // setInstanceCount(): copies 1 .. n-1 run right after the first on
+    // every sub-block. Control and atom inputs are the first instance's,
+    // their control and atom outputs go nowhere.
+    struct InstanceCopy {
+        LilvInstance* instance = nullptr;
+        LV2HostWorker worker;
+        LV2HostWorker restore_worker;
+        std::mutex work_lock;
+        std::vector<float> controls;                // control outputs, by port index
+        std::vector<LV2_Atom_Sequence*> atom_out;   // [tables_.atom_out]
+        std::vector<void*> connected;               // [audio_in, then audio_out]
+        bool on_slice = false;                      // atom inputs on the sub-block slices
+    };
 
-        if (host_worker_.responses) {
-            lv2_ringbuffer_free(host_worker_.responses);
-            host_worker_.responses = nullptr;
+    // RT: copy j on [offset, offset + frames), audio on the channels
+    // after those of copies 0 .. j-1
+    void run_copy(InstanceCopy& c, uint32_t j, float* const* inputs, float* const* outputs,
+                  uint32_t channels, uint32_t offset, uint32_t frames, bool split) {
+        const uint32_t num_in = tables_.audio_in.size();
+        const uint32_t num_out = tables_.audio_out.size();
+        for (uint32_t k = 0; k < num_in; ++k)
+            connect_copy_port(c, k, tables_.audio_in[k], inputs[(j * num_in + k) % channels] + offset);
+        for (uint32_t k = 0; k < num_out; ++k) {
+            const uint32_t ch = j * num_out + k;
+            connect_copy_port(c, num_in + k, tables_.audio_out[k],
+                              (ch < channels ? outputs[ch] : scratch_.data()) + offset);
+        }
+        if (c.on_slice != split) {
+            for (uint32_t i : tables_.atom_in)
+                lilv_instance_connect_port(c.instance, i, split ? ports_[i].atom_slice : ports_[i].atom);
+            c.on_slice = split;
+        }
+        for (size_t k = 0; k < c.atom_out.size(); ++k) {
+            c.atom_out[k]->atom.type = 0;
+            c.atom_out[k]->atom.size = ports_[tables_.atom_out[k]].atom_buf_size - sizeof(LV2_Atom);
         }
+        lilv_instance_run(c.instance, frames);
+    }
 
-        host_worker_.iface = nullptr;
-        host_worker_.dsp_handle = nullptr;
+    void connect_copy_port(InstanceCopy& c, uint32_t slot, uint32_t port, void* buf) {
+        if (buf == c.connected[slot]) return;
+        lilv_instance_connect_port(c.instance, port, buf);
+        c.connected[slot] = buf;
+        LV2HostStats::inc(stats_.port_reconnects);
     }
 
     // ========== Member variables ==========
@@ -995,11 +2011,49 @@ private:
     double sample_rate_;
     uint32_t max_block_length_;
     uint32_t required_atom_size_;
+    uint32_t worker_size_;
+    bool denormal_protection_;
+    float midi_event_density_ = 1.0f;     // setMidiEventDensity()
+    uint32_t instance_count_ = 1;         // setInstanceCount()
+    std::vector<std::unique_ptr<InstanceCopy>> copies_;
+    uint32_t fixed_block_length_ = 0;     // setFixedBlockLength()
+    uint32_t block_length_ = 0;           // frames per run() the plugin sees
+    bool fixed_block_ = false, pow2_block_ = false;
+    LV2BlockAdapter block_adapter_;
+    uint32_t latency_port_ = UINT32_MAX;  // lv2:reportsLatency output
+    LV2IdleGate idle_gate_;
+    std::vector<float> idle_controls_;    // control inputs as of the last block
 
     std::vector<Port> ports_;
+    std::vector<PortMeta> port_meta_;
+    std::vector<ControlRange> ranges_;                              // control ports
+    std::unordered_map<std::string_view, uint32_t> symbol_index_;  // into port_meta_
+    std::vector<PluginControl*> control_by_port_;                   // owned by controls_
+    std::vector<float> control_values_;    // control port buffers, by port index
+    PortTables tables_;
     std::vector<PluginControl*> controls_;
+    std::vector<float> scratch_;
+    int64_t block_pos_ = 0;              // RT: start of this block in the process() call, < 0
+                                         // for a fixed block begun in an earlier call
+    uint32_t midi_out_frames_ = 0;       // RT: frames of the last process() call
+
+    LV2Automation automation_;
+    LV2AutomationQueue* control_queue_ = nullptr;   // queueValue()
 
     LV2HostWorker host_worker_;
+    LV2HostWorker restore_worker_;        // restore() schedules here
+    std::mutex work_lock_;
+    LV2HostStats stats_;
+
+    // ========== State pipeline ==========
+    bool thread_safe_restore_ = false;
+    LV2SnapshotSwap port_swap_;           // restored control values
+    LV2RTPause state_pause_;
+    LV2PortSnapshot* restoring_ = nullptr;
+    std::atomic<bool> values_restored_{false};  // takeRestoredValues()
+    LV2StateThread* state_thread_ = nullptr;
+    std::unique_ptr<LV2StateThread> own_state_thread_;
+    std::shared_ptr<LV2JobGuard> state_guard_ = std::make_shared<LV2JobGuard>();
 
     std::atomic<bool> shutdown_;
 };
@@ -1009,13 +2063,23 @@ private:
 // ============================================================================
 
 inline PluginControl* PluginControl::create(LilvWorld* world, const LilvPlugin* plugin,
-                                            const LilvPort* port, const LilvNode* audio_class,
+                                            const LilvPort* port, const LilvNode* /*audio_class*/,
                                             const LilvNode* control_class, const LilvNode* atom_class) {
+    PluginControl* control = nullptr;
     if (lilv_port_is_a(plugin, port, control_class)) {
-        return new ControlPortFloat(world, plugin, port);
+        LilvNode* trigger = lilv_new_uri(world, LV2_PORT_PROPS__trigger);
+        LilvNode* toggled = lilv_new_uri(world, LV2_CORE__toggled);
+        if (lilv_port_has_property(plugin, port, trigger))
+            control = new TriggerControl(world, plugin, port);
+        else if (lilv_port_has_property(plugin, port, toggled))
+            control = new ToggleControl(world, plugin, port);
+        else
+            control = new ControlPortFloat(world, plugin, port);
+        lilv_node_free(trigger);
+        lilv_node_free(toggled);
     } else if (lilv_port_is_a(plugin, port, atom_class)) {
-        return new AtomPortControl(world, plugin, port);
+        control = new AtomPortControl(world, plugin, port);
     }
-    // TODO: detect toggle/trigger properties
-    return nullptr;
+    if (control) control->port_index_ = lilv_port_get_index(plugin, port);
+    return control;
 }
@@ -0,0 +1,440 @@
+/*
+ * LV2PluginCache.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Plugin discovery cache - Backend Agnostic
+ *
+ * lilv_world_load_all() parses every installed bundle before the first plugin
+ * can be looked up. This cache keeps what a host needs for discovery (URI,
+ * name, bundle, port summary, presets) in a small text file under
+ * $XDG_CACHE_HOME/luma and only reparses bundles whose .ttl files changed.
+ * A host then loads just the bundles of the selected plugin into its world.
+ *
+ * File format, one tab separated record per line:
+ *
+ *   luma-plugin-cache <version>
+ *   B <bundle path> <mtime>
+ *   P <uri> <name> <has binary> <audio in> <audio out> <control in>
+ *     <control out> <atom in> <atom out>
+ *   S <plugin uri> <preset uri> <label>
+ *
+ * P and S records belong to the B record before them.
+ */
+
+#pragma once
+
+#include <lilv/lilv.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// Cached records
+// ============================================================================
+
+struct LV2CachedPlugin {
+    std::string uri;
+    std::string name;
+    bool has_binary = false;    // the bundle holding lv2:binary, not an extension
+    uint32_t audio_in = 0;
+    uint32_t audio_out = 0;
+    uint32_t control_in = 0;
+    uint32_t control_out = 0;
+    uint32_t atom_in = 0;
+    uint32_t atom_out = 0;
+};
+
+struct LV2CachedPreset {
+    std::string plugin_uri;
+    std::string uri;
+    std::string label;
+};
+
+struct LV2CachedBundle {
+    std::string path;           // directory, with trailing '/'
+    int64_t mtime = 0;          // newest of the directory and its .ttl files
+    std::vector<LV2CachedPlugin> plugins;
+    std::vector<LV2CachedPreset> presets;
+};
+
+// ============================================================================
+// LV2PluginCache - on-disk index of the installed LV2 bundles
+// ============================================================================
+
+class LV2PluginCache {
+public:
+    static constexpr int kVersion = 1;
+
+    LV2PluginCache() : path_(defaultPath()) {}
+    explicit LV2PluginCache(std::string path) : path_(std::move(path)) {}
+
+    // Scan the LV2 path, reparse new or changed bundles, drop removed ones
+    // and write the cache back when anything changed. Returns false only
+    // when the cache file could not be written.
+    bool refresh() {
+        if (!loaded_) load();
+
+        std::unordered_map<std::string, LV2CachedBundle> old;
+        old.reserve(bundles_.size());
+        for (auto& b : bundles_) old.emplace(b.path, std::move(b));
+        bundles_.clear();
+
+        bool changed = false;
+        for (const auto& dir : searchPath()) {
+            for (auto& found : scanDirectory(dir)) {
+                auto it = old.find(found.first);
+                if (it != old.end() && it->second.mtime == found.second) {
+                    bundles_.push_back(std::move(it->second));
+                    old.erase(it);
+                    continue;
+                }
+                if (it != old.end()) old.erase(it);
+                bundles_.push_back(parseBundle(found.first, found.second));
+                changed = true;
+            }
+        }
+        if (!old.empty()) changed = true;
+
+        index();
+        return changed ? save() : true;
+    }
+
+    // uri / name pairs, same rules as a plain lilv scan: exact URI or name,
+    // case-insensitive name, or substring of the lowercased name or URI
+    std::vector<std::pair<std::string, std::string>> matches(const std::string& input) const {
+        std::string needle = lower(input);
+        std::vector<std::pair<std::string, std::string>> result;
+        for (const auto& e : entries_) {
+            const LV2CachedPlugin& p = *e.plugin;
+            if (input == p.uri || input == p.name || needle == e.lname ||
+                e.lname.find(needle) != std::string::npos ||
+                p.uri.find(needle) != std::string::npos)
+                result.emplace_back(p.uri, p.name);
+        }
+        return result;
+    }
+
+    const LV2CachedPlugin* find(const std::string& uri) const {
+        auto it = by_uri_.find(uri);
+        return it == by_uri_.end() ? nullptr : entries_[it->second].plugin;
+    }
+
+    // every bundle which describes the plugin or holds presets for it
+    std::vector<std::string> bundlesFor(const std::string& uri) const {
+        std::vector<std::string> result;
+        auto it = by_uri_.find(uri);
+        if (it != by_uri_.end()) result = entries_[it->second].bundles;
+        return result;
+    }
+
+    std::vector<LV2CachedPreset> presetsFor(const std::string& uri) const {
+        std::vector<LV2CachedPreset> result;
+        for (const auto& b : bundles_)
+            for (const auto& s : b.presets)
+                if (s.plugin_uri == uri) result.push_back(s);
+        return result;
+    }
+
+    // load only the bundles of one plugin, false when it is not cached
+    bool loadInto(LilvWorld* world, const std::string& uri) const {
+        const std::vector<std::string> bundles = bundlesFor(uri);
+        if (bundles.empty()) return false;
+        for (const auto& path : bundles) {
+            LilvNode* bundle = lilv_new_file_uri(world, nullptr, path.c_str());
+            lilv_world_load_bundle(world, bundle);
+            lilv_node_free(bundle);
+        }
+        return true;
+    }
+
+    size_t pluginCount() const { return entries_.size(); }
+    const std::string& path() const { return path_; }
+
+    // $XDG_CACHE_HOME/luma/plugins.cache, ~/.cache/luma/plugins.cache
+    static std::string defaultPath() {
+        const char* xdg = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        std::string base;
+        if (xdg && *xdg) base = xdg;
+        else if (home && *home) base = std::string(home) + "/.cache";
+        else base = "/tmp";
+        return base + "/luma/plugins.cache";
+    }
+
+private:
+    struct Entry {
+        const LV2CachedPlugin* plugin;  // the record holding the binary
+        std::string lname;              // lowercased name
+        std::vector<std::string> bundles;
+    };
+
+    static std::string lower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
+    }
+
+    // tabs and newlines separate records
+    static std::string clean(const char* s) {
+        std::string r = s ? s : "";
+        std::replace(r.begin(), r.end(), '\t', ' ');
+        std::replace(r.begin(), r.end(), '\n', ' ');
+        return r;
+    }
+
+    // LV2_PATH, or the lilv defaults plus the lib64 variants
+    static std::vector<std::string> searchPath() {
+        std::string lv2_path;
+        const char* env = getenv("LV2_PATH");
+        if (env && *env) {
+            lv2_path = env;
+        } else {
+            lv2_path = "~/.lv2:/usr/lib/lv2:/usr/local/lib/lv2:"
+                       "/usr/lib64/lv2:/usr/local/lib64/lv2";
+        }
+
+        const char* home = getenv("HOME");
+        std::vector<std::string> dirs;
+        std::stringstream ss(lv2_path);
+        std::string dir;
+        while (std::getline(ss, dir, ':')) {
+            if (dir.empty()) continue;
+            if (dir[0] == '~' && home) dir = home + dir.substr(1);
+            if (dir.back() != '/') dir += '/';
+            if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end())
+                dirs.push_back(dir);
+        }
+        return dirs;
+    }
+
+    static int64_t mtimeOf(const struct stat& st) {
+        return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+
+    // newest of the bundle directory (files added or removed) and its .ttl
+    // files (edited in place), -1 when the path is no directory
+    static int64_t bundleMtime(const std::string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return -1;
+        int64_t newest = mtimeOf(st);
+
+        DIR* d = opendir(path.c_str());
+        if (!d) return newest;
+        while (dirent* e = readdir(d)) {
+            const size_t len = strlen(e->d_name);
+            if (len < 4 || strcmp(e->d_name + len - 4, ".ttl")) continue;
+            if (stat((path + e->d_name).c_str(), &st) == 0)
+                newest = std::max(newest, mtimeOf(st));
+        }
+        closedir(d);
+        return newest;
+    }
+
+    // *.lv2 bundles in one search directory, sorted for a stable file
+    static std::vector<std::pair<std::string, int64_t>> scanDirectory(const std::string& dir) {
+        std::vector<std::pair<std::string, int64_t>> result;
+        DIR* d = opendir(dir.c_str());
+        if (!d) return result;
+        while (dirent* e = readdir(d)) {
+            if (e->d_name[0] == '.') continue;
+            const std::string bundle = dir + e->d_name + "/";
+            const int64_t mtime = bundleMtime(bundle);
+            if (mtime >= 0) result.emplace_back(bundle, mtime);
+        }
+        closedir(d);
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    // parse one bundle in a private world so everything found belongs to it
+    static LV2CachedBundle parseBundle(const std::string& path, int64_t mtime) {
+        LV2CachedBundle b;
+        b.path = path;
+        b.mtime = mtime;
+
+        LilvWorld* world = lilv_world_new();
+        LilvNode* bundle = lilv_new_file_uri(world, nullptr, path.c_str());
+        lilv_world_load_bundle(world, bundle);
+
+        LilvNode* audio = lilv_new_uri(world, LV2_CORE__AudioPort);
+        LilvNode* control = lilv_new_uri(world, LV2_CORE__ControlPort);
+        LilvNode* atom = lilv_new_uri(world, "http://lv2plug.in/ns/ext/atom#AtomPort");
+        LilvNode* input = lilv_new_uri(world, LV2_CORE__InputPort);
+        LilvNode* rdf_type = lilv_new_uri(world, "http://www.w3.org/1999/02/22-rdf-syntax-ns#type");
+        LilvNode* label_pred = lilv_new_uri(world, "http://www.w3.org/2000/01/rdf-schema#label");
+        LilvNode* applies_to = lilv_new_uri(world, LV2_CORE__appliesTo);
+        LilvNode* preset_class = lilv_new_uri(world, "http://lv2plug.in/ns/ext/presets#Preset");
+
+        const LilvPlugins* plugins = lilv_world_get_all_plugins(world);
+        LILV_FOREACH(plugins, i, plugins) {
+            const LilvPlugin* plugin = lilv_plugins_get(plugins, i);
+            LV2CachedPlugin p;
+            p.uri = lilv_node_as_uri(lilv_plugin_get_uri(plugin));
+            p.has_binary = lilv_plugin_get_library_uri(plugin) != nullptr;
+            LilvNode* name = lilv_plugin_get_name(plugin);
+            if (name) {
+                p.name = clean(lilv_node_as_string(name));
+                lilv_node_free(name);
+            }
+            if (p.has_binary) {
+                const uint32_t n = lilv_plugin_get_num_ports(plugin);
+                for (uint32_t k = 0; k < n; ++k) {
+                    const LilvPort* port = lilv_plugin_get_port_by_index(plugin, k);
+                    const bool in = lilv_port_is_a(plugin, port, input);
+                    if (lilv_port_is_a(plugin, port, audio)) ++(in ? p.audio_in : p.audio_out);
+                    else if (lilv_port_is_a(plugin, port, control)) ++(in ? p.control_in : p.control_out);
+                    else if (lilv_port_is_a(plugin, port, atom)) ++(in ? p.atom_in : p.atom_out);
+                }
+            }
+            b.plugins.push_back(std::move(p));
+        }
+
+        LilvNodes* presets = lilv_world_find_nodes(world, nullptr, rdf_type, preset_class);
+        LILV_FOREACH(nodes, i, presets) {
+            const LilvNode* preset = lilv_nodes_get(presets, i);
+            lilv_world_load_resource(world, preset);
+            LilvNode* target = lilv_world_get(world, preset, applies_to, nullptr);
+            if (!target) continue;
+            LV2CachedPreset s;
+            s.plugin_uri = lilv_node_as_uri(target);
+            s.uri = lilv_node_as_uri(preset);
+            LilvNode* label = lilv_world_get(world, preset, label_pred, nullptr);
+            if (label && lilv_node_is_string(label)) s.label = clean(lilv_node_as_string(label));
+            else s.label = s.uri;
+            if (label) lilv_node_free(label);
+            lilv_node_free(target);
+            b.presets.push_back(std::move(s));
+        }
+        lilv_nodes_free(presets);
+
+        for (LilvNode* n : { audio, control, atom, input, rdf_type, label_pred,
+                             applies_to, preset_class, bundle })
+            lilv_node_free(n);
+        lilv_world_free(world);
+        return b;
+    }
+
+    // merge the per bundle records into one entry per plugin URI
+    void index() {
+        std::vector<Entry> all;
+        std::unordered_map<std::string, size_t> pos;
+        for (const auto& b : bundles_) {
+            for (const auto& p : b.plugins) {
+                auto it = pos.emplace(p.uri, all.size()).first;
+                if (it->second == all.size()) all.push_back(Entry{ &p, std::string(), {} });
+                Entry& e = all[it->second];
+                if (p.has_binary && !e.plugin->has_binary) e.plugin = &p;
+                e.bundles.push_back(b.path);
+            }
+        }
+        // preset bundles are loaded along with the plugin they apply to
+        for (const auto& b : bundles_) {
+            for (const auto& s : b.presets) {
+                auto it = pos.find(s.plugin_uri);
+                if (it == pos.end()) continue;
+                auto& bundles = all[it->second].bundles;
+                if (std::find(bundles.begin(), bundles.end(), b.path) == bundles.end())
+                    bundles.push_back(b.path);
+            }
+        }
+
+        // extension bundles alone, without lv2:binary, are no loadable plugin
+        entries_.clear();
+        by_uri_.clear();
+        for (auto& e : all) {
+            if (!e.plugin->has_binary) continue;
+            e.lname = lower(e.plugin->name);
+            by_uri_.emplace(e.plugin->uri, entries_.size());
+            entries_.push_back(std::move(e));
+        }
+    }
+
+    void load() {
+        loaded_ = true;
+        bundles_.clear();
+        std::ifstream in(path_);
+        std::string line;
+        if (!std::getline(in, line) || line != "luma-plugin-cache " + std::to_string(kVersion))
+            return;
+
+        while (std::getline(in, line)) {
+            std::vector<std::string> f;
+            std::stringstream ss(line);
+            std::string field;
+            while (std::getline(ss, field, '\t')) f.push_back(field);
+            if (f.empty()) continue;
+
+            if (f[0] == "B" && f.size() == 3) {
+                LV2CachedBundle b;
+                b.path = f[1];
+                b.mtime = strtoll(f[2].c_str(), nullptr, 10);
+                bundles_.push_back(std::move(b));
+            } else if (f[0] == "P" && f.size() == 10 && !bundles_.empty()) {
+                LV2CachedPlugin p;
+                p.uri = f[1];
+                p.name = f[2];
+                p.has_binary = f[3] == "1";
+                p.audio_in = strtoul(f[4].c_str(), nullptr, 10);
+                p.audio_out = strtoul(f[5].c_str(), nullptr, 10);
+                p.control_in = strtoul(f[6].c_str(), nullptr, 10);
+                p.control_out = strtoul(f[7].c_str(), nullptr, 10);
+                p.atom_in = strtoul(f[8].c_str(), nullptr, 10);
+                p.atom_out = strtoul(f[9].c_str(), nullptr, 10);
+                bundles_.back().plugins.push_back(std::move(p));
+            } else if (f[0] == "S" && f.size() == 4 && !bundles_.empty()) {
+                bundles_.back().presets.push_back({ f[1], f[2], f[3] });
+            }
+        }
+    }
+
+    // write to a temporary file and rename, readers never see half a cache
+    bool save() const {
+        const size_t slash = path_.rfind('/');
+        if (slash != std::string::npos) makeDirs(path_.substr(0, slash));
+
+        const std::string tmp = path_ + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            if (!out) return false;
+            out << "luma-plugin-cache " << kVersion << "\n";
+            for (const auto& b : bundles_) {
+                out << "B\t" << b.path << "\t" << b.mtime << "\n";
+                for (const auto& p : b.plugins) {
+                    out << "P\t" << p.uri << "\t" << p.name << "\t" << (p.has_binary ? 1 : 0)
+                        << "\t" << p.audio_in << "\t" << p.audio_out
+                        << "\t" << p.control_in << "\t" << p.control_out
+                        << "\t" << p.atom_in << "\t" << p.atom_out << "\n";
+                }
+                for (const auto& s : b.presets)
+                    out << "S\t" << s.plugin_uri << "\t" << s.uri << "\t" << s.label << "\n";
+            }
+            if (!out) return false;
+        }
+        return rename(tmp.c_str(), path_.c_str()) == 0;
+    }
+
+    static void makeDirs(const std::string& dir) {
+        for (size_t pos = 1; pos != std::string::npos;) {
+            pos = dir.find('/', pos + 1);
+            mkdir(dir.substr(0, pos).c_str(), 0755);
+        }
+    }
+
+    std::string path_;
+    bool loaded_ = false;
+    std::vector<LV2CachedBundle> bundles_;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, size_t> by_uri_;
+};
@@ -0,0 +1,559 @@
+/*
+ * LV2PluginGraph.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Plugin graph - Backend Agnostic
+ *
+ * Runs several LV2Plugin instances inside one audio callback. The graph is an
+ * ordered list of stages; every stage holds one or more parallel branches and
+ * every branch is a serial chain of plugins. The branches of a stage all read
+ * the stage input bus, and their outputs are summed (with a per-branch gain)
+ * into the stage mix bus, which becomes the input of the next stage.
+ *
+ *   in ─> [A] ─> [B ─> C | D] ─> [E] ─> out
+ *
+ * prepare() turns the stages into a DAG: every plugin is a node depending on
+ * its predecessor in the branch (or on the previous stage mix), and every stage
+ * mix depends on the last plugin of each of its branches. Without workers the
+ * nodes run in topological order on the calling thread; with setWorkerThreads()
+ * independent branches run concurrently on a RTTaskPool.
+ *
+ * Plugins report their latency (lookahead limiters, linear phase EQs). Before
+ * the mix every branch of a stage is delayed up to the latency of its slowest
+ * sibling, so the branches stay phase aligned; getLatency() is what the whole
+ * graph adds and what the host reports to its backend.
+ *
+ * saveSnapshot()/loadSnapshot() store the state of every plugin in one
+ * directory, on a state thread the plugins share; setAutosave() repeats the
+ * save periodically. Neither stops the audio, see LV2StatePipeline.hpp.
+ *
+ * All buffers are allocated in prepare(), process() never allocates.
+ */
+
+#pragma once
+
+#include "LV2Plugin.hpp"
+#include "LV2TaskPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// AudioBus - planar channel buffers with a fixed capacity
+// ============================================================================
+
+struct AudioBus {
+    std::vector<float> storage;
+    std::vector<float*> channels;
+
+    void allocate(uint32_t num_channels, uint32_t frames) {
+        storage.assign((size_t)num_channels * frames, 0.0f);
+        channels.resize(num_channels);
+        for (uint32_t c = 0; c < num_channels; ++c)
+            channels[c] = storage.data() + (size_t)c * frames;
+    }
+};
+
+// ============================================================================
+// DelayLine - per channel ring buffers for latency compensation
+// ============================================================================
+
+// Delays a bus in place by up to max_delay frames, in blocks of up to
+// max_block frames. A new delay takes effect at once, without a crossfade;
+// callers clear() the ring when the delay changes.
+struct DelayLine {
+    AudioBus ring;
+    uint32_t size = 0;
+    uint32_t max_delay = 0;
+    uint32_t pos = 0;
+
+    void allocate(uint32_t num_channels, uint32_t delay, uint32_t max_block) {
+        max_delay = delay;
+        size = delay + max_block;
+        pos = 0;
+        ring.allocate(num_channels, size);
+    }
+
+    // RT: drop what the ring holds, the next block reads back silence
+    void clear() {
+        std::fill(ring.storage.begin(), ring.storage.end(), 0.0f);
+        pos = 0;
+    }
+
+    // RT: write the block in, read it back delay frames late
+    void process(float* const* bus, uint32_t nframes, uint32_t delay) {
+        if (!size) return;
+        delay = std::min(delay, max_delay);
+        const uint32_t read = (pos + size - delay) % size;
+        for (size_t c = 0; c < ring.channels.size(); ++c) {
+            copy_in(ring.channels[c], bus[c], nframes);
+            copy_out(bus[c], ring.channels[c], read, nframes);
+        }
+        pos = (pos + nframes) % size;
+    }
+
+    void copy_in(float* r, const float* src, uint32_t n) const {
+        const uint32_t first = std::min(n, size - pos);
+        memcpy(r + pos, src, first * sizeof(float));
+        memcpy(r, src + first, (n - first) * sizeof(float));
+    }
+
+    void copy_out(float* dst, const float* r, uint32_t from, uint32_t n) const {
+        const uint32_t first = std::min(n, size - from);
+        memcpy(dst, r + from, first * sizeof(float));
+        memcpy(dst + first, r, (n - first) * sizeof(float));
+    }
+};
+
+// ============================================================================
+// LV2PluginGraph - serial chains and parallel branches with a mix bus
+// ============================================================================
+
+class LV2PluginGraph {
+public:
+    LV2PluginGraph(LilvWorld* world, double sample_rate, uint32_t max_block_length,
+                   uint32_t channels = 2)
+        : world_(world), sample_rate_(sample_rate),
+          max_block_length_(max_block_length), channels_(channels),
+          block_in_(channels), block_out_(channels) {}
+
+    // Append a stage holding a single plugin
+    bool addSerial(const std::string& uri) {
+        return addParallel({ { uri } });
+    }
+
+    // Append a stage of parallel branches, each a serial list of plugin URIs
+    bool addParallel(const std::vector<std::vector<std::string>>& branches) {
+        if (branches.empty()) return false;
+
+        Stage stage;
+        for (const auto& uris : branches) {
+            if (uris.empty()) return false;
+            Branch branch;
+            for (const auto& uri : uris) {
+                auto plugin = std::make_unique<LV2Plugin>(world_, uri.c_str(),
+                                                          sample_rate_, max_block_length_);
+                if (worker_size_) plugin->setWorkerSize(worker_size_);
+                plugin->setDenormalProtection(denormal_protection_);
+                if (!plugin->initialize()) return false;
+                plugin->setStateThread(&state_thread_);
+                branch.plugins.push_back(std::move(plugin));
+            }
+            stage.branches.push_back(std::move(branch));
+        }
+        stages_.push_back(std::move(stage));
+        prepared_ = false;
+        return true;
+    }
+
+    // Longest latency difference between the branches of a stage that is
+    // compensated, only before prepare()
+    void setMaxLatencyCompensation(uint32_t frames) { max_compensation_ = frames; }
+
+    // RT-safe: frames the graph delays its output by, the sum of the
+    // slowest branch of every stage. Changes when a plugin reports a new
+    // latency, hosts poll it after process().
+    uint32_t getLatency() const {
+        uint32_t frames = 0;
+        for (const auto& stage : stages_) frames += stage_latency(stage);
+        return frames;
+    }
+
+    // Idle bypass for every plugin added so far, see LV2Plugin::setIdleBypass()
+    void setIdleBypass(float tail_seconds) {
+        for (auto& stage : stages_)
+            for (auto& branch : stage.branches)
+                for (auto& plugin : branch.plugins) plugin->setIdleBypass(tail_seconds);
+    }
+
+    // Control smoothing for every plugin added so far, see
+    // LV2Plugin::setControlSmoothing()
+    void setControlSmoothing(float ms, LV2RampCurve curve = LV2RampCurve::Linear) {
+        for (auto& stage : stages_)
+            for (auto& branch : stage.branches)
+                for (auto& plugin : branch.plugins) plugin->setControlSmoothing(ms, curve);
+    }
+
+    // For the plugins added from here on, see LV2Plugin::setWorkerSize()
+    // and LV2Plugin::setDenormalProtection(); 0 keeps the default size
+    void setWorkerSize(uint32_t bytes) { worker_size_ = bytes; }
+    void setDenormalProtection(bool on) { denormal_protection_ = on; }
+
+    // State of every plugin into dir/plugin-N/state.ttl, N counting in
+    // graph order, as a job on the state thread. done(ok) is called there.
+    void saveSnapshot(const std::string& dir, std::function<void(bool)> done = nullptr) {
+        state_thread_.post([this, dir, done] {
+            const bool ok = for_each_state(dir, [](LV2Plugin& p, const std::string& path) {
+                return p.saveState(path);
+            });
+            if (done) done(ok);
+        });
+    }
+
+    // Restore a saveSnapshot() of the same graph, see LV2Plugin::loadState()
+    void loadSnapshot(const std::string& dir, std::function<void(bool)> done = nullptr) {
+        state_thread_.post([this, dir, done] {
+            const bool ok = for_each_state(dir, [](LV2Plugin& p, const std::string& path) {
+                return p.loadState(path);
+            });
+            if (done) done(ok);
+        });
+    }
+
+    // saveSnapshot(dir, done) every interval, 0 stops the autosave
+    void setAutosave(const std::string& dir, std::chrono::milliseconds interval,
+                     std::function<void(bool)> done = nullptr) {
+        state_thread_.setPeriodic(interval, [this, dir, done] {
+            const bool ok = for_each_state(dir, [](LV2Plugin& p, const std::string& path) {
+                return p.saveState(path);
+            });
+            if (done) done(ok);
+        });
+    }
+
+    // Block until the snapshots posted so far are done
+    void waitSnapshots() { state_thread_.wait(); }
+
+    // Set the mix gain of a branch, only before prepare()
+    void setBranchGain(size_t stage, size_t branch, float gain) {
+        if (stage < stages_.size() && branch < stages_[stage].branches.size())
+            stages_[stage].branches[branch].gain = gain;
+    }
+
+    // Allocate all intermediate buffers and build the task graph,
+    // call once the graph is complete. Workers set before are restarted
+    // on the new task graph.
+    void prepare() {
+        pool_.stop();
+        for (auto& stage : stages_) {
+            for (auto& branch : stage.branches) {
+                branch.ping.allocate(channels_, max_block_length_);
+                branch.pong.allocate(channels_, max_block_length_);
+            }
+            if (stage.branches.size() > 1) {
+                stage.mix.allocate(channels_, max_block_length_);
+                for (auto& branch : stage.branches) {
+                    branch.delay.allocate(channels_, max_compensation_, max_block_length_);
+                    branch.lag = 0;
+                }
+            }
+        }
+        build_tasks();
+        prepared_ = true;
+        if (pool_workers_) start_pool();
+    }
+
+    // Non-RT: run independent branches on worker threads, 0 runs everything
+    // on the calling thread. Call after prepare(); policy/priority should be
+    // those of the audio thread.
+    bool setWorkerThreads(uint32_t workers, int policy = SCHED_OTHER, int priority = 0) {
+        pool_.stop();
+        pool_workers_ = workers;
+        pool_policy_ = policy;
+        pool_priority_ = priority;
+        return start_pool();
+    }
+
+    uint32_t getWorkerThreads() const { return pool_.workerCount(); }
+
+    // RT-safe: run the whole graph for one period. A period longer than
+    // the block length the plugins were built for runs in several blocks.
+    void process(const float* const* inputs, float* const* outputs, uint32_t nframes) {
+        if (!prepared_ || stages_.empty()) {
+            for (uint32_t c = 0; c < channels_; ++c)
+                memset(outputs[c], 0, nframes * sizeof(float));
+            return;
+        }
+        if (nframes <= max_block_length_) {
+            process_block(inputs, outputs, nframes);
+            return;
+        }
+        for (uint32_t done = 0; done < nframes;) {
+            const uint32_t n = std::min(nframes - done, max_block_length_);
+            for (uint32_t c = 0; c < channels_; ++c) {
+                block_in_[c] = inputs[c] + done;
+                block_out_[c] = outputs[c] + done;
+            }
+            process_block(block_in_.data(), block_out_.data(), n);
+            done += n;
+        }
+    }
+
+    uint32_t getMaxBlockLength() const { return max_block_length_; }
+    uint32_t getChannelCount() const { return channels_; }
+    size_t getStageCount() const { return stages_.size(); }
+
+    // widest stage, the number of branches that can run at the same time
+    size_t getMaxParallelism() const {
+        size_t n = 0;
+        for (const auto& stage : stages_) n = std::max(n, stage.branches.size());
+        return n;
+    }
+
+    // Latency changes that left a branch lagging by more than
+    // setMaxLatencyCompensation(), its output is no longer aligned with
+    // the slowest branch of its stage. Hosts poll it off the RT thread.
+    uint64_t getCompensationOverruns() const {
+        return compensation_overruns_.load(std::memory_order_relaxed);
+    }
+
+    // run() calls of all plugins that raised denormal flags. The plugins
+    // sample the flags around their own run(), a host compares the sum
+    // across its cycle instead of sampling them again.
+    uint64_t getDenormalCycles() const {
+        uint64_t n = 0;
+        for (const auto& stage : stages_)
+            for (const auto& branch : stage.branches)
+                for (const auto& plugin : branch.plugins)
+                    n += plugin->getStats().denormal_cycles.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    size_t getPluginCount() const {
+        size_t n = 0;
+        for (const auto& stage : stages_)
+            for (const auto& branch : stage.branches) n += branch.plugins.size();
+        return n;
+    }
+
+private:
+    struct Branch {
+        std::vector<std::unique_ptr<LV2Plugin>> plugins;
+        float gain = 1.0f;
+        AudioBus ping, pong;
+        DelayLine delay;            // parallel stages only
+        uint32_t lag = 0;           // frames delay was last run with
+        float* const* result = nullptr;
+    };
+
+    struct Stage {
+        std::vector<Branch> branches;
+        AudioBus mix;
+        // output of the previous stage mix, written by its mix node
+        float* const* input = nullptr;
+    };
+
+    // one plugin of a branch, or the mix of a stage when index == MIX
+    struct Node {
+        static constexpr uint32_t MIX = UINT32_MAX;
+        uint32_t stage;
+        uint32_t branch;
+        uint32_t index;
+    };
+
+    // ------------------------------------------------------------------------
+    // Snapshots, on the state thread
+    // ------------------------------------------------------------------------
+
+    template <typename Fn>
+    bool for_each_state(const std::string& dir, Fn&& fn) {
+        bool ok = true;
+        size_t n = 0;
+        for (auto& stage : stages_)
+            for (auto& branch : stage.branches)
+                for (auto& plugin : branch.plugins)
+                    ok &= fn(*plugin, dir + "/plugin-" + std::to_string(n++) + "/state.ttl");
+        return ok;
+    }
+
+    // ------------------------------------------------------------------------
+    // Task graph
+    // ------------------------------------------------------------------------
+
+    // binds the pool to the current tasks_, its arrays are sized for them
+    bool start_pool() {
+        if (!prepared_ || pool_workers_ == 0 || getMaxParallelism() < 2) return false;
+        return pool_.start(&tasks_, run_task, this, pool_workers_, pool_policy_, pool_priority_);
+    }
+
+    void build_tasks() {
+        nodes_.clear();
+        std::vector<std::vector<uint32_t>> succ;
+        std::vector<uint32_t> deps;
+
+        auto add_node = [&](uint32_t s, uint32_t b, uint32_t i) {
+            nodes_.push_back({ s, b, i });
+            succ.emplace_back();
+            deps.push_back(0);
+            return (uint32_t)nodes_.size() - 1;
+        };
+        auto add_edge = [&](uint32_t from, uint32_t to) {
+            succ[from].push_back(to);
+            ++deps[to];
+        };
+
+        uint32_t prev_mix = Node::MIX;
+        for (uint32_t s = 0; s < stages_.size(); ++s) {
+            std::vector<uint32_t> tails;
+            for (uint32_t b = 0; b < stages_[s].branches.size(); ++b) {
+                uint32_t prev = prev_mix;
+                for (uint32_t i = 0; i < stages_[s].branches[b].plugins.size(); ++i) {
+                    const uint32_t n = add_node(s, b, i);
+                    if (prev != Node::MIX) add_edge(prev, n);
+                    prev = n;
+                }
+                tails.push_back(prev);
+            }
+            const uint32_t mix = add_node(s, 0, Node::MIX);
+            for (uint32_t t : tails) add_edge(t, mix);
+            prev_mix = mix;
+        }
+
+        tasks_ = TaskGraph();
+        tasks_.count = (uint32_t)nodes_.size();
+        tasks_.deps = deps;
+        tasks_.succ_begin.push_back(0);
+        for (const auto& list : succ) {
+            tasks_.succ.insert(tasks_.succ.end(), list.begin(), list.end());
+            tasks_.succ_begin.push_back((uint32_t)tasks_.succ.size());
+        }
+
+        // Kahn's algorithm, gives the serial order and the roots
+        std::vector<uint32_t> pending = deps;
+        for (uint32_t n = 0; n < tasks_.count; ++n)
+            if (!deps[n]) tasks_.roots.push_back(n);
+        tasks_.order = tasks_.roots;
+        for (size_t k = 0; k < tasks_.order.size(); ++k) {
+            for (uint32_t to : succ[tasks_.order[k]])
+                if (--pending[to] == 0) tasks_.order.push_back(to);
+        }
+    }
+
+    // RT: one block of at most max_block_length_ frames through the DAG
+    void process_block(const float* const* inputs, float* const* outputs, uint32_t nframes) {
+        nframes_ = nframes;
+        stages_[0].input = const_cast<float* const*>(inputs);
+        if (pool_.workerCount()) {
+            pool_.run();
+        } else {
+            for (uint32_t t : tasks_.order) execute(t);
+        }
+
+        float* const* bus = result_;
+        for (uint32_t c = 0; c < channels_; ++c) {
+            if (outputs[c] != bus[c])
+                memcpy(outputs[c], bus[c], nframes * sizeof(float));
+        }
+    }
+
+    static void run_task(void* ctx, uint32_t task) {
+        static_cast<LV2PluginGraph*>(ctx)->execute(task);
+    }
+
+    // RT: called from the audio thread or a pool worker, once all the
+    // dependencies of the node have finished
+    void execute(uint32_t task) {
+        const Node& node = nodes_[task];
+        Stage& stage = stages_[node.stage];
+
+        if (node.index == Node::MIX) {
+            float* const* bus = mix_stage(stage, nframes_);
+            if (node.stage + 1 < stages_.size()) stages_[node.stage + 1].input = bus;
+            else result_ = bus;
+            return;
+        }
+
+        Branch& branch = stage.branches[node.branch];
+        const uint32_t i = node.index;
+        float* const* src = i == 0 ? stage.input
+                          : ((i - 1) & 1) ? branch.pong.channels.data()
+                                          : branch.ping.channels.data();
+        // plugins alternate between ping and pong so none runs in place
+        float* const* dst = (i & 1) ? branch.pong.channels.data()
+                                    : branch.ping.channels.data();
+        // a failing plugin is bypassed
+        if (!branch.plugins[i]->process(src, dst, channels_, nframes_)) {
+            for (uint32_t c = 0; c < channels_; ++c)
+                memcpy(dst[c], src[c], nframes_ * sizeof(float));
+        }
+        if (i + 1 == branch.plugins.size()) branch.result = dst;
+    }
+
+    static uint32_t branch_latency(const Branch& branch) {
+        uint32_t frames = 0;
+        for (const auto& plugin : branch.plugins) frames += plugin->getLatency();
+        return frames;
+    }
+
+    static uint32_t stage_latency(const Stage& stage) {
+        uint32_t frames = 0;
+        for (const auto& branch : stage.branches)
+            frames = std::max(frames, branch_latency(branch));
+        return frames;
+    }
+
+    float* const* mix_stage(Stage& stage, uint32_t nframes) {
+        if (stage.branches.size() == 1 && stage.branches[0].gain == 1.0f)
+            return stage.branches[0].result;
+
+        if (stage.branches.size() == 1) {
+            // apply the gain in place, the branch buffers are ours
+            Branch& b = stage.branches[0];
+            for (uint32_t c = 0; c < channels_; ++c)
+                for (uint32_t i = 0; i < nframes; ++i) b.result[c][i] *= b.gain;
+            return b.result;
+        }
+
+        // align the branches on the slowest one, in their own buffers
+        const uint32_t latency = stage_latency(stage);
+        for (auto& branch : stage.branches) {
+            const uint32_t lag = latency - branch_latency(branch);
+            if (lag != branch.lag) {
+                // what the ring holds was delayed for the old lag, and
+                // while the lag was 0 the ring was not written at all
+                branch.delay.clear();
+                if (lag > branch.delay.max_delay)
+                    compensation_overruns_.fetch_add(1, std::memory_order_relaxed);
+                branch.lag = lag;
+            }
+            if (lag) branch.delay.process(branch.result, nframes, lag);
+        }
+
+        float* const* mix = stage.mix.channels.data();
+        for (uint32_t c = 0; c < channels_; ++c) {
+            float* dst = mix[c];
+            const Branch& first = stage.branches[0];
+            for (uint32_t i = 0; i < nframes; ++i) dst[i] = first.result[c][i] * first.gain;
+            for (size_t b = 1; b < stage.branches.size(); ++b) {
+                const Branch& br = stage.branches[b];
+                for (uint32_t i = 0; i < nframes; ++i) dst[i] += br.result[c][i] * br.gain;
+            }
+        }
+        return mix;
+    }
+
+    LilvWorld* world_;
+    double sample_rate_;
+    uint32_t max_block_length_;
+    uint32_t channels_;
+    uint32_t max_compensation_ = 8192;
+    std::atomic<uint64_t> compensation_overruns_{0};
+    uint32_t worker_size_ = 0;
+    bool denormal_protection_ = true;
+    bool prepared_ = false;
+
+    std::vector<Stage> stages_;
+    std::vector<Node> nodes_;
+    TaskGraph tasks_;
+    uint32_t pool_workers_ = 0;             // setWorkerThreads()
+    int pool_policy_ = SCHED_OTHER;
+    int pool_priority_ = 0;
+    uint32_t nframes_ = 0;
+    std::vector<const float*> block_in_;     // a long period, one block at a time
+    std::vector<float*> block_out_;
+    float* const* result_ = nullptr;
+
+    // after the stages, so snapshots finish before the plugins go away
+    LV2StateThread state_thread_;
+
+    // declared last, so the workers are joined before the plugins go away
+    RTTaskPool pool_;
+};
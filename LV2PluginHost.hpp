@@ -0,0 +1,153 @@
+/*
+ * LV2PluginHost.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * One LV2Plugin driven by an audio backend - Backend Agnostic
+ *
+ * LV2Plugin is the engine: ports, atom queues, worker, automation, block
+ * adapter, idle gate and state all live there once. A backend only moves
+ * audio between its own buffers and the planar channels process() reads,
+ * and it plugs in at compile time:
+ *
+ *   class MyBackend : public LV2PluginHost<MyBackend> {
+ *       uint32_t chunkFrames() const;             // largest chunk acquire() takes
+ *       void acquire(uint32_t offset, uint32_t frames, LV2IOBlock& io);
+ *       void release(uint32_t offset, uint32_t frames, const LV2IOBlock& io);
+ *   };
+ *
+ * runCycle() calls them through the derived type, so every backend gets one
+ * process loop with its buffer handling inlined and no virtual call per
+ * cycle. LV2OboeHost deinterleaves the device buffer, LV2OfflineHost below
+ * hands the caller's planar buffers through, and the benchmark runs the
+ * same loop as the device callback.
+ */
+
+#pragma once
+
+#include "LV2Plugin.hpp"
+#include "LV2PerfMonitor.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+// ============================================================================
+// LV2IOBlock - the planar view of one chunk
+// ============================================================================
+
+struct LV2IOBlock {
+    float* const* inputs = nullptr;
+    float* const* outputs = nullptr;    // may be the same buffers as inputs
+    uint32_t channels = 0;
+};
+
+// ============================================================================
+// LV2PluginHost - the process loop, specialized per backend
+// ============================================================================
+
+template <typename Backend>
+class LV2PluginHost {
+public:
+    // Creates and initializes the plugin. setup(LV2Plugin&) runs before
+    // initialize(), for the options that must be set by then.
+    template <typename Setup>
+    bool openPlugin(LilvWorld* world, const char* uri, double sample_rate,
+                    uint32_t max_block_length, Setup&& setup) {
+        closePlugin();
+        plugin_ = std::make_unique<LV2Plugin>(world, uri, sample_rate, max_block_length);
+        setup(*plugin_);
+        if (!plugin_->initialize()) {
+            plugin_.reset();
+            return false;
+        }
+        sample_rate_ = sample_rate;
+        return true;
+    }
+
+    bool openPlugin(LilvWorld* world, const char* uri, double sample_rate,
+                    uint32_t max_block_length) {
+        return openPlugin(world, uri, sample_rate, max_block_length, [](LV2Plugin&) {});
+    }
+
+    void closePlugin() { plugin_.reset(); }
+
+    LV2Plugin* getPlugin() { return plugin_.get(); }
+    const LV2Plugin* getPlugin() const { return plugin_.get(); }
+
+    // cycle timing, DSP load histogram and xruns, enable() before the
+    // first cycle
+    LV2PerfMonitor& getPerf() { return perf_; }
+
+protected:
+    LV2PluginHost() = default;
+    ~LV2PluginHost() = default;
+
+    // RT: one backend cycle of nframes, in chunks the backend can stage
+    bool runCycle(uint32_t nframes) {
+        if (!plugin_ || nframes == 0) return false;
+        Backend& backend = static_cast<Backend&>(*this);
+
+        LV2CycleRecord cycle;
+        const bool timed = perf_.enabled();
+        if (timed) cycle.start_ns = LV2PerfMonitor::now();
+
+        bool ok = true;
+        const uint32_t chunk = std::max(1u, backend.chunkFrames());
+        for (uint32_t done = 0; done < nframes && ok;) {
+            const uint32_t n = std::min(nframes - done, chunk);
+            LV2IOBlock io;
+            backend.acquire(done, n, io);
+            ok = plugin_->process(io.inputs, io.outputs, io.channels, (int)n,
+                                  timed ? &cycle : nullptr);
+            backend.release(done, n, io);
+            done += n;
+        }
+
+        if (timed) {
+            cycle.frames = nframes;
+            cycle.budget_ns = (uint32_t)(1e9 * nframes / sample_rate_);
+            cycle.cycle_ns = (uint32_t)(LV2PerfMonitor::now() - cycle.start_ns);
+            perf_.record(cycle);
+        }
+        return ok;
+    }
+
+    std::unique_ptr<LV2Plugin> plugin_;
+    LV2PerfMonitor perf_;
+    double sample_rate_ = 48000.0;
+};
+
+// ============================================================================
+// LV2OfflineHost - caller owned planar buffers, no device
+// ============================================================================
+
+// Offline rendering and benchmarks. The buffers go straight to the plugin,
+// the block adapter splits renders longer than the block length.
+class LV2OfflineHost : public LV2PluginHost<LV2OfflineHost> {
+public:
+    // in and out hold channels buffers of nframes, they may be the same
+    bool render(float* const* in, float* const* out, uint32_t channels, uint32_t nframes) {
+        in_ = in;
+        out_ = out;
+        channels_ = channels;
+        return runCycle(nframes);
+    }
+
+private:
+    friend class LV2PluginHost<LV2OfflineHost>;
+
+    uint32_t chunkFrames() const { return UINT32_MAX; }
+
+    void acquire(uint32_t, uint32_t, LV2IOBlock& io) {
+        io.inputs = in_;
+        io.outputs = out_;
+        io.channels = channels_;
+    }
+
+    void release(uint32_t, uint32_t, const LV2IOBlock&) {}
+
+    float* const* in_ = nullptr;
+    float* const* out_ = nullptr;
+    uint32_t channels_ = 0;
+};
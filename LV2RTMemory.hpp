@@ -0,0 +1,96 @@
+/*
+ * LV2RTMemory.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Realtime memory setup - Backend Agnostic
+ *
+ * The audio thread must not take page faults: the first touch of a fresh
+ * page costs a trip into the kernel, a swapped out page much more. Hosts
+ * call lockAll() once at startup, lock() every buffer the RT side uses
+ * (atom ports, UI and worker rings) and prefaultStack() on the RT thread
+ * before its first cycle.
+ *
+ * mlockall(MCL_FUTURE) is only used with an unlimited RLIMIT_MEMLOCK: under
+ * a limit it makes every allocation past the limit fail. Otherwise buffers
+ * are pinned one by one with mlock() as long as the limit allows, and are
+ * at least prefaulted when it does not.
+ */
+
+#pragma once
+
+#include "lv2_ringbuffer.h"
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ============================================================================
+// LV2RTMemory - lock and prefault what the audio thread touches
+// ============================================================================
+
+class LV2RTMemory {
+public:
+    static constexpr size_t kStackPrefault = 128 * 1024;
+
+    // process wide, once. True when all current and future pages are locked.
+    static bool lockAll() {
+        static const bool locked = [] {
+            rlimit lim;
+            if (getrlimit(RLIMIT_MEMLOCK, &lim) != 0 || lim.rlim_cur != RLIM_INFINITY)
+                return false;
+            return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+        }();
+        if (locked) all_locked().store(true, std::memory_order_relaxed);
+        return locked;
+    }
+
+    // write every page once, keeps the contents
+    static void prefault(void* data, size_t bytes) {
+        if (!data || !bytes) return;
+        volatile uint8_t* p = static_cast<volatile uint8_t*>(data);
+        const size_t page = pageSize();
+        for (size_t i = 0; i < bytes; i += page) p[i] = p[i];
+        p[bytes - 1] = p[bytes - 1];
+    }
+
+    // prefault, then pin unless mlockall() already did. False when the
+    // buffer could only be prefaulted.
+    static bool lock(void* data, size_t bytes) {
+        if (!data || !bytes) return true;
+        prefault(data, bytes);
+        if (all_locked().load(std::memory_order_relaxed)) return true;
+        return mlock(data, bytes) == 0;
+    }
+
+    static bool lock(lv2_ringbuffer_t* rb) {
+        return rb ? lock(rb->buf, rb->size) : true;
+    }
+
+    // on the RT thread: grow the stack now instead of during a cycle
+    __attribute__((noinline)) static void prefaultStack() {
+        uint8_t stack[kStackPrefault];
+        memset(stack, 0, sizeof(stack));
+        // keep the stores, nothing reads the array
+        __asm__ __volatile__("" : : "r"(stack) : "memory");
+    }
+
+private:
+    static std::atomic<bool>& all_locked() {
+        static std::atomic<bool> locked{false};
+        return locked;
+    }
+
+    static size_t pageSize() {
+        static const size_t page = [] {
+            const long p = sysconf(_SC_PAGESIZE);
+            return p > 0 ? (size_t)p : (size_t)4096;
+        }();
+        return page;
+    }
+};
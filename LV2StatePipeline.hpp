@@ -0,0 +1,258 @@
+/*
+ * LV2StatePipeline.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * State save/restore off the audio and UI threads - Backend Agnostic
+ *
+ * Saving a sampler or IR loader can take seconds, and a restore racing the
+ * audio thread is undefined unless the plugin declares state:threadSafeRestore.
+ * The pieces here keep both away from the callers:
+ *
+ *   LV2StateThread   runs capture, serialization and file I/O as jobs on a
+ *                    background thread, plus an optional periodic autosave
+ *   LV2SnapshotSwap  hands restored control values to the audio thread as
+ *                    one snapshot, applied at the start of a cycle
+ *   LV2RTPause       for plugins without threadSafeRestore: the audio thread
+ *                    outputs silence for the few cycles restore() runs
+ *   LV2JobGuard      lets queued jobs outlive the object they were posted for
+ *
+ * save() may run concurrently with run() by the state spec, so captures
+ * never pause the audio.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// LV2SnapshotSwap - restored port values, published to the audio thread
+// ============================================================================
+
+struct LV2PortSnapshot {
+    std::vector<std::pair<uint32_t, float>> values;     // port index, value
+    std::atomic<bool> consumed{false};
+};
+
+class LV2SnapshotSwap {
+public:
+    ~LV2SnapshotSwap() {
+        for (LV2PortSnapshot* snap : live_) delete snap;
+    }
+
+    // non-RT: replaces a snapshot the audio thread has not taken yet
+    void publish(std::unique_ptr<LV2PortSnapshot> snap) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        collect();
+        live_.push_back(snap.get());
+        // taken back before the audio thread saw it
+        LV2PortSnapshot* old = pending_.exchange(snap.release(), std::memory_order_acq_rel);
+        if (old) old->consumed.store(true, std::memory_order_relaxed);
+    }
+
+    // RT: set(port, value) for every value of a published snapshot
+    template <typename Set>
+    bool apply(Set&& set) {
+        LV2PortSnapshot* snap = pending_.exchange(nullptr, std::memory_order_acq_rel);
+        if (!snap) return false;
+        for (const auto& v : snap->values) set(v.first, v.second);
+        snap->consumed.store(true, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // non-RT: free the snapshots the audio thread is done with
+    void collect() {
+        for (size_t k = 0; k < live_.size();) {
+            if (live_[k]->consumed.load(std::memory_order_acquire)) {
+                delete live_[k];
+                live_[k] = live_.back();
+                live_.pop_back();
+            } else {
+                ++k;
+            }
+        }
+    }
+
+    std::atomic<LV2PortSnapshot*> pending_{nullptr};
+    std::vector<LV2PortSnapshot*> live_;    // published, freed once consumed
+    std::mutex mutex_;
+};
+
+// ============================================================================
+// LV2RTPause - keep the audio thread out of run() while restore() runs
+// ============================================================================
+
+// The audio thread brackets its cycle with enter()/leave() and skips run()
+// when enter() fails. pause() returns once no cycle is inside, seq_cst on
+// both flags so neither side can miss the other.
+class LV2RTPause {
+public:
+    // RT: false while paused, the cycle writes silence instead
+    bool enter() {
+        inside_.store(true);
+        if (!paused_.load()) return true;
+        inside_.store(false);
+        return false;
+    }
+
+    // RT
+    void leave() { inside_.store(false); }
+
+    // non-RT: blocks for at most the cycle in flight
+    void pause() {
+        paused_.store(true);
+        while (inside_.load()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    void resume() { paused_.store(false); }
+
+private:
+    std::atomic<bool> paused_{false};
+    std::atomic<bool> inside_{false};
+};
+
+// ============================================================================
+// LV2StateThread - background jobs and periodic autosave
+// ============================================================================
+
+// Jobs run one at a time in the order posted. They use the lilv world,
+// which is not thread safe: nothing else may use it while they run.
+class LV2StateThread {
+public:
+    using Job = std::function<void()>;
+
+    ~LV2StateThread() { stop(); }
+
+    // any thread
+    void post(Job job) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+            start_locked(lock);
+        }
+        wake_.notify_one();
+    }
+
+    // run job every interval, 0 switches the autosave off
+    void setPeriodic(std::chrono::milliseconds interval, Job job) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            interval_ = interval;
+            periodic_ = std::move(job);
+            next_ = std::chrono::steady_clock::now() + interval_;
+            if (interval_.count() > 0) start_locked(lock);
+        }
+        wake_.notify_one();
+    }
+
+    // block until every job posted so far has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return jobs_.empty() && !busy_; });
+    }
+
+    // finishes the queued jobs, then joins. The thread is joined with
+    // mutex_ released, it takes the lock on its way out.
+    void stop() {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+            thread = std::move(thread_);
+            ++stopping_;
+        }
+        wake_.notify_one();
+        if (thread.joinable()) thread.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --stopping_;
+        }
+        idle_.notify_all();
+    }
+
+private:
+    // A post() racing stop() waits for the old thread to be joined, so
+    // jobs never run on two threads
+    void start_locked(std::unique_lock<std::mutex>& lock) {
+        idle_.wait(lock, [this] { return stopping_ == 0; });
+        if (running_) return;
+        running_ = true;
+        thread_ = std::thread([this] { run(); });
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            if (jobs_.empty()) {
+                if (!running_) break;
+                if (interval_.count() > 0) wake_.wait_until(lock, next_);
+                else wake_.wait(lock);
+            }
+            Job job;
+            if (!jobs_.empty()) {
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            } else if (running_ && interval_.count() > 0 &&
+                       std::chrono::steady_clock::now() >= next_) {
+                job = periodic_;
+                next_ = std::chrono::steady_clock::now() + interval_;
+            }
+            if (!job) continue;
+            busy_ = true;
+            lock.unlock();
+            job();
+            lock.lock();
+            busy_ = false;
+            idle_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_, idle_;
+    std::deque<Job> jobs_;
+    Job periodic_;
+    std::chrono::milliseconds interval_{0};
+    std::chrono::steady_clock::time_point next_;
+    std::thread thread_;
+    bool running_ = false;
+    bool busy_ = false;
+    uint32_t stopping_ = 0;     // stop() calls joining outside the lock
+};
+
+// ============================================================================
+// LV2JobGuard - jobs posted for an object that may go away first
+// ============================================================================
+
+// Jobs hold a shared_ptr to the guard of their object instead of relying on
+// the object. revoke() blocks for the job in flight, later ones are skipped.
+class LV2JobGuard {
+public:
+    // job thread: f() unless revoked, false when skipped
+    template <typename F>
+    bool run(F&& f) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (revoked_) return false;
+        f();
+        return true;
+    }
+
+    void revoke() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        revoked_ = true;
+    }
+
+private:
+    std::mutex mutex_;
+    bool revoked_ = false;
+};
@@ -0,0 +1,250 @@
+/*
+ * LV2TaskPool.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Realtime task pool - Backend Agnostic
+ *
+ * Runs a fixed DAG of tasks once per audio period on a set of pinned worker
+ * threads. Every participant owns a Chase-Lev work-stealing deque; a task is
+ * pushed onto the deque of the thread that completed its last dependency, and
+ * idle threads steal from the others. The calling (audio) thread takes part in
+ * the work and then waits on a lock-free completion counter.
+ *
+ * The hot path uses atomics only: no locks, no allocation, no system calls
+ * except one sem_post() per worker to wake it for the period.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+#include "LV2RTMemory.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// ============================================================================
+// TaskGraph - immutable DAG in compressed sparse row form
+// ============================================================================
+
+struct TaskGraph {
+    uint32_t count = 0;
+    std::vector<uint32_t> deps;         // number of dependencies per task
+    std::vector<uint32_t> succ_begin;   // count + 1 offsets into succ
+    std::vector<uint32_t> succ;         // successor task ids
+    std::vector<uint32_t> roots;        // tasks without dependencies
+    std::vector<uint32_t> order;        // a topological order
+};
+
+// ============================================================================
+// TaskDeque - fixed capacity Chase-Lev deque (owner: push/pop, others: steal)
+// ============================================================================
+
+class TaskDeque {
+public:
+    void init(size_t capacity) {
+        size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        buf_.reset(new std::atomic<uint32_t>[cap]);
+        mask_ = cap - 1;
+        top_.store(0, std::memory_order_relaxed);
+        bottom_.store(0, std::memory_order_relaxed);
+    }
+
+    void push(uint32_t task) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        buf_[b & mask_].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    bool pop(uint32_t& task) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        task = buf_[b & mask_].load(std::memory_order_relaxed);
+        if (t == b) {
+            // last element, race against thieves
+            const bool won = top_.compare_exchange_strong(t, t + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(uint32_t& task) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return false;
+        task = buf_[t & mask_].load(std::memory_order_relaxed);
+        return top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint32_t>[]> buf_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+};
+
+// ============================================================================
+// RTTaskPool - pinned realtime workers executing a TaskGraph per period
+// ============================================================================
+
+class RTTaskPool {
+public:
+    using RunFn = void (*)(void* ctx, uint32_t task);
+
+    ~RTTaskPool() {
+        stop();
+    }
+
+    // Non-RT: bind the graph and start the workers. policy/priority are
+    // applied to every worker (pass the audio thread's values to inherit them).
+    bool start(const TaskGraph* graph, RunFn fn, void* ctx, uint32_t workers,
+               int policy = SCHED_OTHER, int priority = 0) {
+        stop();
+        if (!graph || !fn || graph->count == 0) return false;
+
+        graph_ = graph;
+        fn_ = fn;
+        ctx_ = ctx;
+        pending_.reset(new std::atomic<uint32_t>[graph->count]);
+        deques_.reset(new TaskDeque[workers + 1]);
+        participants_ = workers + 1;
+        for (uint32_t i = 0; i < participants_; ++i) deques_[i].init(graph->count);
+
+        sem_init(&wake_, 0, 0);
+        running_.store(true, std::memory_order_release);
+
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (uint32_t w = 1; w <= workers; ++w) {
+            threads_.emplace_back(worker_func, this, w);
+            pthread_t th = threads_.back().native_handle();
+            if (policy != SCHED_OTHER) {
+                sched_param sp;
+                sp.sched_priority = priority;
+                pthread_setschedparam(th, policy, &sp);
+            }
+#ifdef __linux__
+            if (cpus > 1) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(w % cpus, &set);
+                pthread_setaffinity_np(th, sizeof(set), &set);
+            }
+#endif
+        }
+        return true;
+    }
+
+    // Non-RT: joins the workers and unbinds the graph, workerCount() is 0
+    // until the next start()
+    void stop() {
+        if (running_.exchange(false)) {
+            for (size_t i = 0; i < threads_.size(); ++i) sem_post(&wake_);
+            for (auto& t : threads_)
+                if (t.joinable()) t.join();
+            threads_.clear();
+            sem_destroy(&wake_);
+        }
+        participants_ = 0;
+        graph_ = nullptr;
+        fn_ = nullptr;
+        ctx_ = nullptr;
+        pending_.reset();
+        deques_.reset();
+    }
+
+    uint32_t workerCount() const { return participants_ ? participants_ - 1 : 0; }
+
+    // RT: run every task of the graph once, the caller is participant 0
+    void run() {
+        const TaskGraph& g = *graph_;
+        for (uint32_t i = 0; i < g.count; ++i)
+            pending_[i].store(g.deps[i], std::memory_order_relaxed);
+        remaining_.store(g.count, std::memory_order_release);
+
+        for (uint32_t r : g.roots) deques_[0].push(r);
+        for (size_t i = 0; i < threads_.size(); ++i) sem_post(&wake_);
+
+        work(0);
+    }
+
+private:
+    static void worker_func(RTTaskPool* pool, uint32_t self) {
+        LV2RTMemory::prefaultStack();
+        while (true) {
+            sem_wait(&pool->wake_);
+            if (!pool->running_.load(std::memory_order_acquire)) break;
+            pool->work(self);
+        }
+    }
+
+    void work(uint32_t self) {
+        uint32_t task;
+        while (remaining_.load(std::memory_order_acquire) != 0) {
+            if (deques_[self].pop(task) || steal(self, task)) execute(self, task);
+            else cpu_relax();
+        }
+    }
+
+    bool steal(uint32_t self, uint32_t& task) {
+        for (uint32_t i = 1; i < participants_; ++i) {
+            if (deques_[(self + i) % participants_].steal(task)) return true;
+        }
+        return false;
+    }
+
+    void execute(uint32_t self, uint32_t task) {
+        fn_(ctx_, task);
+        const TaskGraph& g = *graph_;
+        for (uint32_t i = g.succ_begin[task]; i < g.succ_begin[task + 1]; ++i) {
+            const uint32_t s = g.succ[i];
+            if (pending_[s].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                deques_[self].push(s);
+        }
+        remaining_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    const TaskGraph* graph_ = nullptr;
+    RunFn fn_ = nullptr;
+    void* ctx_ = nullptr;
+
+    std::unique_ptr<std::atomic<uint32_t>[]> pending_;
+    std::unique_ptr<TaskDeque[]> deques_;
+    uint32_t participants_ = 0;
+    alignas(64) std::atomic<uint32_t> remaining_{0};
+
+    sem_t wake_;
+    std::atomic<bool> running_{false};
+    std::vector<std::thread> threads_;
+};
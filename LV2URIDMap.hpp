@@ -0,0 +1,160 @@
+/*
+ * LV2URIDMap.hpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Process wide URID table - Backend Agnostic
+ *
+ * Plugins call urid:map from run(), the worker and the UI thread, so one table
+ * is shared by every host and plugin instance in the process. Looking up an
+ * URI that is already mapped is lock-free and allocation-free: an open
+ * addressing hash table of immutable entries, readers only load atomics.
+ * Unknown URIs take a mutex, allocate their entry and publish it. The table
+ * grows by publishing a bigger copy; replaced tables stay alive until the
+ * process ends, so a reader never touches freed memory.
+ *
+ * unmap indexes a chunked dense array by URID, O(1) and wait-free.
+ */
+
+#pragma once
+
+#include <lv2/urid/urid.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// LV2URIDMap - URI <-> URID, one per process
+// ============================================================================
+
+class LV2URIDMap {
+public:
+    static LV2URIDMap& instance() {
+        static LV2URIDMap map;
+        return map;
+    }
+
+    // any thread, lock-free for URIs mapped before
+    LV2_URID map(const char* uri) {
+        if (!uri) return 0;
+        const uint64_t h = hash(uri);
+        if (LV2_URID id = find(table_.load(std::memory_order_acquire), h, uri))
+            return id;
+
+        std::lock_guard<std::mutex> lock(insert_mutex_);
+        Table* t = table_.load(std::memory_order_relaxed);
+        // another thread may have inserted it while we waited
+        if (LV2_URID id = find(t, h, uri)) return id;
+
+        const uint32_t n = size_.load(std::memory_order_relaxed);
+        if ((n >> kChunkBits) >= kMaxChunks) return 0;
+        if ((n + 1) * 2 > t->mask + 1) t = grow(t);
+
+        Entry* e = new Entry{ h, n + 1, uri };
+        Entry**& chunk = chunks_[n >> kChunkBits];
+        if (!chunk) chunk = new Entry*[kChunkSize]();
+        chunk[n & kChunkMask] = e;
+        insert(t, e);
+        // publishes the chunk slot for unmap()
+        size_.store(n + 1, std::memory_order_release);
+        return e->id;
+    }
+
+    // any thread, wait-free, nullptr for unknown URIDs
+    const char* unmap(LV2_URID id) const {
+        if (id == 0 || id > size_.load(std::memory_order_acquire)) return nullptr;
+        const uint32_t i = id - 1;
+        return chunks_[i >> kChunkBits][i & kChunkMask]->uri.c_str();
+    }
+
+    uint32_t size() const { return size_.load(std::memory_order_acquire); }
+
+    // LV2_URID_Map / LV2_URID_Unmap callbacks, the handle is the table
+    static LV2_URID mapCallback(LV2_URID_Map_Handle h, const char* uri) {
+        return static_cast<LV2URIDMap*>(h)->map(uri);
+    }
+
+    static const char* unmapCallback(LV2_URID_Unmap_Handle h, LV2_URID id) {
+        return static_cast<LV2URIDMap*>(h)->unmap(id);
+    }
+
+    LV2URIDMap(const LV2URIDMap&) = delete;
+    LV2URIDMap& operator=(const LV2URIDMap&) = delete;
+
+private:
+    static constexpr uint32_t kChunkBits = 10;
+    static constexpr uint32_t kChunkSize = 1u << kChunkBits;
+    static constexpr uint32_t kChunkMask = kChunkSize - 1;
+    static constexpr uint32_t kMaxChunks = 4096;    // 4M URIDs
+
+    struct Entry {
+        uint64_t hash;
+        LV2_URID id;
+        std::string uri;
+    };
+
+    struct Table {
+        size_t mask = 0;
+        std::unique_ptr<std::atomic<const Entry*>[]> slots;
+
+        explicit Table(size_t capacity) : mask(capacity - 1),
+            slots(new std::atomic<const Entry*>[capacity]) {
+            for (size_t i = 0; i < capacity; ++i)
+                slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    LV2URIDMap() {
+        tables_.emplace_back(new Table(1024));
+        table_.store(tables_.back().get(), std::memory_order_release);
+    }
+
+    ~LV2URIDMap() {
+        const uint32_t n = size_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; ++i) delete chunks_[i >> kChunkBits][i & kChunkMask];
+        for (uint32_t c = 0; c < kMaxChunks; ++c) delete[] chunks_[c];
+    }
+
+    // FNV-1a
+    static uint64_t hash(const char* s) {
+        uint64_t h = 14695981039346656037ull;
+        for (; *s; ++s) h = (h ^ (uint8_t)*s) * 1099511628211ull;
+        return h;
+    }
+
+    static LV2_URID find(const Table* t, uint64_t h, const char* uri) {
+        for (size_t i = h & t->mask;; i = (i + 1) & t->mask) {
+            const Entry* e = t->slots[i].load(std::memory_order_acquire);
+            if (!e) return 0;
+            if (e->hash == h && e->uri == uri) return e->id;
+        }
+    }
+
+    // insert path only, under insert_mutex_
+    static void insert(Table* t, const Entry* e) {
+        size_t i = e->hash & t->mask;
+        while (t->slots[i].load(std::memory_order_relaxed)) i = (i + 1) & t->mask;
+        t->slots[i].store(e, std::memory_order_release);
+    }
+
+    Table* grow(const Table* old) {
+        tables_.emplace_back(new Table((old->mask + 1) * 2));
+        Table* t = tables_.back().get();
+        const uint32_t n = size_.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; ++i) insert(t, chunks_[i >> kChunkBits][i & kChunkMask]);
+        table_.store(t, std::memory_order_release);
+        return t;
+    }
+
+    std::atomic<Table*> table_{nullptr};
+    std::atomic<uint32_t> size_{0};
+    Entry** chunks_[kMaxChunks] = {};
+
+    std::mutex insert_mutex_;
+    std::vector<std::unique_ptr<Table>> tables_;    // current one last
+};
@@ -0,0 +1,312 @@
+/*
+ * bench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2026 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+        bench.cpp - headless offline render / benchmark for Luma
+
+        Streams a WAV/raw file (or generated noise) through a
+        plugin as fast as possible, without JACK or X11, and
+        reports the DSP cost per block size. The plugin runs in
+        the process loop the device hosts use (LV2PluginHost.hpp).
+
+****************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include "LV2PluginHost.hpp"
+
+struct BenchOptions {
+    std::string uri;
+    std::string input_file;
+    double seconds = 10.0;
+    double sample_rate = 48000.0;
+    std::vector<uint32_t> block_sizes { 64, 128, 256, 512, 1024 };
+    uint32_t warmup_blocks = 16;
+};
+
+static void print_usage(const char* name) {
+    std::cout << "Luma offline benchmark\n";
+    std::cout << "Usage:\n";
+    std::cout << "  " << name << " [options] plugin_uri\n";
+    std::cout << "Options:\n";
+    std::cout << "  -i file     input file (.wav PCM16/24/32 or float, else raw float32)\n";
+    std::cout << "  -n seconds  length of generated noise when no input file (default 10)\n";
+    std::cout << "  -r rate     sample rate (default 48000, WAV header overrides)\n";
+    std::cout << "  -b sizes    comma separated block sizes (default 64,128,256,512,1024)\n";
+    std::cout << "  -w blocks   warmup blocks excluded from statistics (default 16)\n";
+}
+
+static bool parse_block_sizes(const std::string& arg, std::vector<uint32_t>& out) {
+    out.clear();
+    std::istringstream iss(arg);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        try {
+            int v = std::stoi(item);
+            if (v <= 0) return false;
+            out.push_back(static_cast<uint32_t>(v));
+        } catch (...) {
+            return false;
+        }
+    }
+    return !out.empty();
+}
+
+static bool parse_args(int argc, char* argv[], BenchOptions& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        try {
+            if (a == "-i" && has_value) opt.input_file = argv[++i];
+            else if (a == "-n" && has_value) opt.seconds = std::stod(argv[++i]);
+            else if (a == "-r" && has_value) opt.sample_rate = std::stod(argv[++i]);
+            else if (a == "-w" && has_value) opt.warmup_blocks = std::stoi(argv[++i]);
+            else if (a == "-b" && has_value) {
+                if (!parse_block_sizes(argv[++i], opt.block_sizes)) return false;
+            }
+            else if (!a.empty() && a[0] == '-') return false;
+            else opt.uri = a;
+        } catch (...) {
+            return false;
+        }
+    }
+    return !opt.uri.empty() && opt.seconds > 0.0 && opt.sample_rate > 0.0;
+}
+
+/****************************************************************
+            INPUT - load a mono mixdown of the input file
+                    or generate white noise
+
+****************************************************************/
+
+static uint32_t read_le(const uint8_t* p, int bytes) {
+    uint32_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static bool is_wav(const std::vector<uint8_t>& d) {
+    return d.size() >= 12 && !memcmp(d.data(), "RIFF", 4) && !memcmp(d.data() + 8, "WAVE", 4);
+}
+
+static bool load_wav(const std::vector<uint8_t>& d, std::vector<float>& out, double& rate) {
+    if (!is_wav(d)) return false;
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    size_t pos = 12;
+    while (pos + 8 <= d.size()) {
+        const uint8_t* chunk = d.data() + pos;
+        uint32_t size = read_le(chunk + 4, 4);
+        const uint8_t* body = chunk + 8;
+        if (pos + 8 + size > d.size()) size = d.size() - pos - 8;
+
+        if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+            format   = read_le(body, 2);
+            channels = read_le(body + 2, 2);
+            rate     = read_le(body + 4, 4);
+            bits     = read_le(body + 14, 2);
+            // WAVE_FORMAT_EXTENSIBLE carries the real format in the sub format GUID
+            if (format == 0xFFFE && size >= 26) format = read_le(body + 24, 2);
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!channels || !bits) return false;
+            const int bytes = bits / 8;
+            const size_t frames = size / (bytes * channels);
+            out.resize(frames);
+            for (size_t f = 0; f < frames; ++f) {
+                float sum = 0.0f;
+                for (int c = 0; c < channels; ++c) {
+                    const uint8_t* s = body + (f * channels + c) * bytes;
+                    if (format == 3 && bits == 32) {
+                        float v;
+                        memcpy(&v, s, sizeof(float));
+                        sum += v;
+                    } else if (format == 1 && bits >= 16 && bits <= 32) {
+                        // sign extend the sample into the top bits of an int32
+                        int32_t v = (int32_t)(read_le(s, bytes) << (32 - bits));
+                        sum += v / 2147483648.0f;
+                    } else {
+                        return false;
+                    }
+                }
+                out[f] = sum / channels;
+            }
+            return true;
+        }
+        pos += 8 + size + (size & 1);
+    }
+    return false;
+}
+
+static bool load_input(const BenchOptions& opt, std::vector<float>& out, double& rate) {
+    std::ifstream f(opt.input_file, std::ios::binary);
+    if (!f) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)),
+                               std::istreambuf_iterator<char>());
+
+    if (load_wav(data, out, rate)) return true;
+    // a WAV file the parser can not read is not raw float data either
+    if (is_wav(data)) {
+        std::cerr << opt.input_file << ": unsupported WAV format, "
+                  << "16-32 bit integer PCM and 32 bit float are read\n";
+        return false;
+    }
+
+    // anything else is taken as headerless mono float32
+    out.resize(data.size() / sizeof(float));
+    memcpy(out.data(), data.data(), out.size() * sizeof(float));
+    return !out.empty();
+}
+
+static void generate_noise(std::vector<float>& out, size_t frames) {
+    out.resize(frames);
+    uint32_t state = 0x12345678;
+    for (auto& s : out) {
+        // xorshift32, scaled to [-0.5, 0.5]
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        s = (state / 4294967296.0f) - 0.5f;
+    }
+}
+
+/****************************************************************
+            RUN - stream the input through one plugin instance
+
+****************************************************************/
+
+struct BenchResult {
+    uint32_t block_size = 0;
+    size_t blocks = 0;
+    size_t frames = 0;
+    double total_sec = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+    double budget_us = 0.0;
+    size_t xruns = 0;
+};
+
+static bool run_bench(LilvWorld* world, const BenchOptions& opt, double rate,
+                      const std::vector<float>& input, uint32_t block, BenchResult& res) {
+
+    LV2OfflineHost host;
+    if (!host.openPlugin(world, opt.uri.c_str(), rate, block)) return false;
+
+    std::vector<float> in(block, 0.0f);
+    std::vector<float> out(block, 0.0f);
+    float* in_ptr = in.data();
+    float* out_ptr = out.data();
+    std::vector<double> cycles;
+    cycles.reserve(input.size() / block + 1);
+
+    res.block_size = block;
+    res.budget_us = block * 1e6 / rate;
+
+    size_t pos = 0;
+    uint32_t warmup = opt.warmup_blocks;
+    while (pos < input.size()) {
+        const uint32_t n = std::min<size_t>(block, input.size() - pos);
+        std::copy(input.begin() + pos, input.begin() + pos + n, in.begin());
+        pos += n;
+
+        auto t0 = std::chrono::steady_clock::now();
+        if (!host.render(&in_ptr, &out_ptr, 1, n)) return false;
+        auto t1 = std::chrono::steady_clock::now();
+
+        if (warmup) {
+            --warmup;
+            continue;
+        }
+
+        const double us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+        // a block that takes longer than its own duration would be an xrun in realtime
+        if (us > n * 1e6 / rate) ++res.xruns;
+        res.total_sec += us * 1e-6;
+        res.frames += n;
+        cycles.push_back(us);
+    }
+
+    if (cycles.empty()) return false;
+    res.blocks = cycles.size();
+    std::sort(cycles.begin(), cycles.end());
+    res.p50_us = cycles[cycles.size() / 2];
+    res.p99_us = cycles[std::min(cycles.size() - 1, cycles.size() * 99 / 100)];
+    res.max_us = cycles.back();
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+
+    BenchOptions opt;
+    if (!parse_args(argc, argv, opt)) {
+        print_usage(argv[0]);
+        return argc < 2 ? 0 : 1;
+    }
+
+    double rate = opt.sample_rate;
+    std::vector<float> input;
+    if (!opt.input_file.empty()) {
+        if (!load_input(opt, input, rate)) {
+            std::cerr << "Failed to read " << opt.input_file << "\n";
+            return 1;
+        }
+    } else {
+        generate_noise(input, static_cast<size_t>(opt.seconds * rate));
+    }
+
+    LilvWorld* world = lilv_world_new();
+    lilv_world_load_all(world);
+
+    const double audio_sec = input.size() / rate;
+    std::cout << "Plugin: " << opt.uri << "\n";
+    std::cout << "Input:  " << (opt.input_file.empty() ? "white noise" : opt.input_file)
+              << ", " << input.size() << " frames @ " << rate << " Hz ("
+              << std::fixed << std::setprecision(2) << audio_sec << " s)\n\n";
+
+    std::cout << std::setw(7) << "block" << std::setw(9) << "blocks"
+              << std::setw(11) << "rt-factor" << std::setw(11) << "p50 us"
+              << std::setw(11) << "p99 us" << std::setw(11) << "max us"
+              << std::setw(11) << "budget us" << std::setw(8) << "xruns" << "\n";
+
+    int ret = 0;
+    for (uint32_t block : opt.block_sizes) {
+        // the warmup blocks are not measured, something has to be left
+        const size_t blocks = (input.size() + block - 1) / block;
+        if (blocks <= opt.warmup_blocks) {
+            std::cerr << "Input too short: " << blocks << " blocks of " << block
+                      << " frames, " << opt.warmup_blocks << " of them warmup\n";
+            ret = 1;
+            break;
+        }
+        BenchResult res;
+        if (!run_bench(world, opt, rate, input, block, res)) {
+            std::cerr << "Failed to run plugin at block size " << block << "\n";
+            ret = 1;
+            break;
+        }
+        const double measured_sec = res.frames / rate;
+        const double rt_factor = res.total_sec > 0.0 ? measured_sec / res.total_sec : 0.0;
+        std::cout << std::setw(7) << res.block_size << std::setw(9) << res.blocks
+                  << std::setw(10) << std::setprecision(1) << rt_factor << "x"
+                  << std::setw(11) << std::setprecision(2) << res.p50_us
+                  << std::setw(11) << res.p99_us << std::setw(11) << res.max_us
+                  << std::setw(11) << res.budget_us << std::setw(8) << res.xruns << "\n";
+    }
+
+    lilv_world_free(world);
+    return ret;
+}
@@ -33,6 +33,12 @@ static inline bool is_power_of_two(size_t x) {
     return x && !(x & (x - 1));
 }
 
+static inline size_t next_power_of_two(size_t x) {
+    size_t p = 1;
+    while (p < x) p <<= 1;
+    return p;
+}
+
 static inline lv2_ringbuffer_t* lv2_ringbuffer_create(size_t sz) {
 
     if (!is_power_of_two(sz)) return nullptr;
@@ -81,16 +87,41 @@ static inline size_t lv2_ringbuffer_write_space(const lv2_ringbuffer_t* rb) {
     return rb->size - lv2_ringbuffer_read_space(rb);
 }
 
+typedef struct {
+    uint8_t* buf;
+    size_t   len;
+} lv2_ringbuffer_data_t;
+
+/****************************************************************
+        bulk copies - at most two memcpy around the wrap point
+
+****************************************************************/
+
+static inline void lv2_ringbuffer_copy_out(const lv2_ringbuffer_t* rb,
+                                        size_t pos, uint8_t* dst, size_t cnt) {
+
+    const size_t off = pos & rb->size_mask;
+    const size_t first = (cnt < rb->size - off) ? cnt : rb->size - off;
+    memcpy(dst, rb->buf + off, first);
+    if (cnt > first) memcpy(dst + first, rb->buf, cnt - first);
+}
+
+static inline void lv2_ringbuffer_copy_in(lv2_ringbuffer_t* rb,
+                                        size_t pos, const uint8_t* src, size_t cnt) {
+
+    const size_t off = pos & rb->size_mask;
+    const size_t first = (cnt < rb->size - off) ? cnt : rb->size - off;
+    memcpy(rb->buf + off, src, first);
+    if (cnt > first) memcpy(rb->buf, src + first, cnt - first);
+}
+
 static inline size_t lv2_ringbuffer_peek(lv2_ringbuffer_t* rb,
                                         char* dst, size_t cnt) {
 
     size_t avail = lv2_ringbuffer_read_space(rb);
     if (cnt > avail) cnt = avail;
     size_t r = rb->read_ptr.load(std::memory_order_relaxed);
-
-    for (size_t i = 0; i < cnt; ++i)
-        dst[i] = rb->buf[(r + i) & rb->size_mask];
-
+    lv2_ringbuffer_copy_out(rb, r, (uint8_t*)dst, cnt);
     return cnt;
 }
 
@@ -102,17 +133,122 @@ static inline size_t lv2_ringbuffer_read(lv2_ringbuffer_t* rb,
     return cnt;
 }
 
+static inline void lv2_ringbuffer_read_advance(lv2_ringbuffer_t* rb, size_t cnt) {
+
+    size_t avail = lv2_ringbuffer_read_space(rb);
+    if (cnt > avail) cnt = avail;
+    rb->read_ptr.fetch_add(cnt, std::memory_order_release);
+}
+
 static inline size_t lv2_ringbuffer_write(lv2_ringbuffer_t* rb,
                                         const char* src, size_t cnt) {
 
     size_t space = lv2_ringbuffer_write_space(rb);
     if (cnt > space) cnt = space;
     size_t w = rb->write_ptr.load(std::memory_order_relaxed);
+    lv2_ringbuffer_copy_in(rb, w, (const uint8_t*)src, cnt);
+    rb->write_ptr.fetch_add(cnt, std::memory_order_release);
+    return cnt;
+}
 
-    for (size_t i = 0; i < cnt; ++i)
-        rb->buf[(w + i) & rb->size_mask] = src[i];
+static inline void lv2_ringbuffer_write_advance(lv2_ringbuffer_t* rb, size_t cnt) {
 
+    size_t space = lv2_ringbuffer_write_space(rb);
+    if (cnt > space) cnt = space;
     rb->write_ptr.fetch_add(cnt, std::memory_order_release);
-    return cnt;
 }
 
+/****************************************************************
+        vectors - zero copy access like jack_ringbuffer_get_*_vector,
+                  vec[1].len is 0 unless the region wraps
+
+****************************************************************/
+
+static inline void lv2_ringbuffer_get_read_vector(const lv2_ringbuffer_t* rb,
+                                        lv2_ringbuffer_data_t vec[2]) {
+
+    const size_t avail = lv2_ringbuffer_read_space(rb);
+    const size_t off = rb->read_ptr.load(std::memory_order_relaxed) & rb->size_mask;
+    const size_t first = (avail < rb->size - off) ? avail : rb->size - off;
+    vec[0].buf = rb->buf + off;
+    vec[0].len = first;
+    vec[1].buf = rb->buf;
+    vec[1].len = avail - first;
+}
+
+static inline void lv2_ringbuffer_get_write_vector(const lv2_ringbuffer_t* rb,
+                                        lv2_ringbuffer_data_t vec[2]) {
+
+    const size_t space = lv2_ringbuffer_write_space(rb);
+    const size_t off = rb->write_ptr.load(std::memory_order_relaxed) & rb->size_mask;
+    const size_t first = (space < rb->size - off) ? space : rb->size - off;
+    vec[0].buf = rb->buf + off;
+    vec[0].len = first;
+    vec[1].buf = rb->buf;
+    vec[1].len = space - first;
+}
+
+/****************************************************************
+        messages - an 8 byte header starting with the uint32_t
+                   body size (an LV2_Atom fits), followed by the
+                   body and padded to 8 bytes, so every message
+                   starts 64 bit aligned in the ring
+
+****************************************************************/
+
+#define LV2_RINGBUFFER_MSG_HEADER 8
+
+static inline size_t lv2_ringbuffer_msg_pad(size_t cnt) {
+
+    return (cnt + 7) & ~(size_t)7;
+}
+
+// write a header and a body as one message: all or nothing, the reader
+// never sees the header without its body
+static inline bool lv2_ringbuffer_write_msg(lv2_ringbuffer_t* rb,
+                                        const void* hdr, size_t hdr_size,
+                                        const void* body, size_t body_size) {
+
+    if (hdr_size != LV2_RINGBUFFER_MSG_HEADER) return false;
+    const size_t padded = lv2_ringbuffer_msg_pad(hdr_size + body_size);
+    if (lv2_ringbuffer_write_space(rb) < padded) return false;
+
+    size_t w = rb->write_ptr.load(std::memory_order_relaxed);
+    lv2_ringbuffer_copy_in(rb, w, (const uint8_t*)hdr, hdr_size);
+    lv2_ringbuffer_copy_in(rb, w + hdr_size, (const uint8_t*)body, body_size);
+
+    rb->write_ptr.fetch_add(padded, std::memory_order_release);
+    return true;
+}
+
+// next complete message: returns header + body, pointing straight into
+// the ring when contiguous, else copied to scratch. *msg_size receives the
+// header + body size, nullptr with *msg_size != 0 means scratch is too small
+static inline const uint8_t* lv2_ringbuffer_peek_msg(lv2_ringbuffer_t* rb,
+                                        uint8_t* scratch, size_t scratch_size,
+                                        size_t* msg_size) {
+
+    *msg_size = 0;
+    lv2_ringbuffer_data_t vec[2];
+    lv2_ringbuffer_get_read_vector(rb, vec);
+    if (vec[0].len + vec[1].len < LV2_RINGBUFFER_MSG_HEADER) return nullptr;
+
+    // headers never wrap, messages start 8 byte aligned
+    uint32_t body_size;
+    memcpy(&body_size, vec[0].buf, sizeof(uint32_t));
+    const size_t total = LV2_RINGBUFFER_MSG_HEADER + body_size;
+    if (vec[0].len + vec[1].len < total) return nullptr;
+    *msg_size = total;
+
+    if (vec[0].len >= total) return vec[0].buf;
+    if (scratch_size < total) return nullptr;
+    memcpy(scratch, vec[0].buf, vec[0].len);
+    memcpy(scratch + vec[0].len, vec[1].buf, total - vec[0].len);
+    return scratch;
+}
+
+// consume the message returned by lv2_ringbuffer_peek_msg()
+static inline void lv2_ringbuffer_release_msg(lv2_ringbuffer_t* rb, size_t msg_size) {
+
+    lv2_ringbuffer_read_advance(rb, lv2_ringbuffer_msg_pad(msg_size));
+}
@@ -19,8 +19,10 @@
 #include <algorithm>
 #include <sstream>
 #include <limits>
+#include <cstdlib>
 
 #include "LV2JackX11Host.hpp"
+#include "LV2JackChainHost.hpp"
 
 static int last_drawn_lines = 0;
 
@@ -108,15 +110,194 @@ int pager_print_plugins(const std::vector<std::pair<std::string, std::string>>&
     return -1;
 }
 
+// --stats: one line per second on stderr while the plugin runs
+static void print_perf_report(const LV2PerfReport& r) {
+    std::cerr << std::fixed << std::setprecision(1)
+              << "\r  DSP p50 " << r.load_p50 * 100.0 << "%  p99 " << r.load_p99 * 100.0
+              << "%  max " << r.load_max * 100.0 << "%  | run " << r.run_mean_us
+              << "/" << r.run_max_us << " us of " << r.budget_us << " us  | xruns "
+              << r.xruns << "  | denormal " << r.denormal_cycles << " (" << r.denormal_spikes
+              << " spikes)";
+    if (r.idle_cycles)
+        std::cerr << "  | idle " << 100.0 * r.idle_cycles / std::max<uint64_t>(r.cycles, 1)
+                  << "% saves " << r.idle_saved * 100.0 << "%";
+    std::cerr << "   " << std::flush;
+}
+
+// --stats: the DSP load histogram, printed on exit
+static void print_perf_histogram(const LV2PerfMonitor& perf) {
+    const LV2PerfReport r = perf.report();
+    const LV2LoadHistogram h = perf.histogram();
+    if (!h.total()) return;
+    std::cerr << "\n\n  DSP load over " << h.total() << " cycles, " << r.xruns
+              << " xruns, " << r.dropped << " records dropped\n";
+    uint64_t peak = 0;
+    for (uint32_t i = 0; i < LV2LoadHistogram::kBuckets; ++i) peak = std::max(peak, h.count(i));
+    for (uint32_t i = 0; i < LV2LoadHistogram::kBuckets; ++i) {
+        if (!h.count(i)) continue;
+        std::cerr << "  " << std::setw(8) << std::setprecision(2)
+                  << LV2LoadHistogram::lower(i) * 1e-4 << "% " << std::setw(10) << h.count(i)
+                  << " " << std::string((size_t)(40 * h.count(i) / peak), '#') << "\n";
+    }
+}
+
+// command line options shared by the plugin and the chain mode
+struct HostOptions {
+    uint32_t worker_size = 0;
+    uint32_t instances = 1;
+    float smooth_ms = 0.0f;
+    float idle_tail = 0.0f;
+    std::string autosave_dir;
+    float autosave_s = 0.0f;
+    bool use_cache = true;
+    bool perf_stats = false;
+    bool ftz = true;
+    std::string perf_shm;
+};
+
+// headless chain mode:  --chain uriA uriB [ uriC | uriD uriE ] uriF
+// plain arguments are serial stages, brackets hold parallel branches
+// separated by '|', every branch may itself be a serial list.
+// "-j N" before the chain sets the worker threads (0 = JACK thread only).
+// While running, "s dir" saves the state of every plugin to dir and
+// "l dir" restores it.
+int run_chain(int argc, char *argv[], const HostOptions& opt) {
+    // linked copies need the single plugin host
+    if (opt.instances > 1) {
+        std::cerr << "--instances is not supported with --chain\n";
+        return 1;
+    }
+    LV2JackChainHost host;
+    host.set_use_cache(opt.use_cache);
+    host.set_idle_bypass(opt.idle_tail);
+    host.set_autosave(opt.autosave_dir, opt.autosave_s);
+    host.set_worker_size(opt.worker_size);
+    host.set_denormal_protection(opt.ftz);
+    host.set_control_smoothing(opt.smooth_ms);
+    if (opt.perf_stats) {
+        host.set_perf_stats(true);
+        host.getPerf().onReport(print_perf_report);
+        if (!opt.perf_shm.empty() && !host.getPerf().exportShared(opt.perf_shm))
+            std::cerr << "Could not export stats to " << opt.perf_shm << "\n";
+    }
+    if (!host.init()) {
+        std::cerr << "Could not open JACK client\n";
+        return 1;
+    }
+
+    int first = 2;
+    if (argc > 3 && std::string(argv[2]) == "-j") {
+        host.set_threads(atoi(argv[3]));
+        first = 4;
+    }
+
+    for (int i = first; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg != "[") {
+            if (!host.add_serial(arg)) return 1;
+            continue;
+        }
+        std::vector<std::vector<std::string>> branches(1);
+        bool closed = false;
+        for (++i; i < argc; ++i) {
+            std::string b = argv[i];
+            if (b == "]") { closed = true; break; }
+            if (b == "|") branches.emplace_back();
+            else branches.back().push_back(b);
+        }
+        if (!closed || !host.add_parallel(branches)) {
+            std::cerr << "Invalid parallel stage\n";
+            return 1;
+        }
+    }
+
+    if (!host.activate()) {
+        std::cerr << "Could not start chain\n";
+        return 1;
+    }
+
+    std::cout << "  Running " << host.plugin_count() << " plugins, "
+              << "s dir = save, l dir = load, q = quit\n";
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line == "q" || line == "Q") break;
+        if (line.size() > 2 && line[0] == 's' && line[1] == ' ') host.save_snapshot(line.substr(2));
+        if (line.size() > 2 && line[0] == 'l' && line[1] == ' ') host.load_snapshot(line.substr(2));
+    }
+
+    host.closeHost();
+    if (opt.perf_stats) print_perf_histogram(host.getPerf());
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
 
+    // --worker-size bytes: largest message a plugin passes through its worker
+    // --no-cache: skip the discovery cache and let lilv scan everything
+    // --stats: report DSP load and xruns, --stats-shm name: also export
+    // them to a POSIX shared memory segment
+    // --no-ftz: leave denormals enabled on the audio and worker threads
+    // --smooth ms: ramp control changes over ms instead of jumping
+    // --idle-bypass s: skip run() after s seconds of silence in and out
+    // --instances n: n linked copies of the plugin, one UI for all (not with --chain).
+    // Only the first copy's control, atom and MIDI outputs are used, those
+    // of the other copies are discarded.
+    // --autosave dir s: chain mode saves every plugin's state to dir every s seconds
+    HostOptions opts;
+    while (argc >= 2) {
+        std::string opt = argv[1];
+        int used = 0;
+        if (opt == "--worker-size" && argc >= 3) {
+            opts.worker_size = strtoul(argv[2], nullptr, 10);
+            used = 2;
+        } else if (opt == "--no-cache") {
+            opts.use_cache = false;
+            used = 1;
+        } else if (opt == "--no-ftz") {
+            opts.ftz = false;
+            used = 1;
+        } else if (opt == "--smooth" && argc >= 3) {
+            opts.smooth_ms = strtof(argv[2], nullptr);
+            used = 2;
+        } else if (opt == "--instances" && argc >= 3) {
+            opts.instances = strtoul(argv[2], nullptr, 10);
+            used = 2;
+        } else if (opt == "--idle-bypass" && argc >= 3) {
+            opts.idle_tail = strtof(argv[2], nullptr);
+            used = 2;
+        } else if (opt == "--autosave" && argc >= 4) {
+            opts.autosave_dir = argv[2];
+            opts.autosave_s = strtof(argv[3], nullptr);
+            used = 3;
+        } else if (opt == "--stats") {
+            opts.perf_stats = true;
+            used = 1;
+        } else if (opt == "--stats-shm" && argc >= 3) {
+            opts.perf_stats = true;
+            opts.perf_shm = argv[2];
+            used = 2;
+        } else {
+            break;
+        }
+        char* prog = argv[0];
+        argc -= used;
+        argv += used;
+        argv[0] = prog;
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "--chain")
+        return run_chain(argc, argv, opts);
+
     if (0 == XInitThreads())
         std::cerr << "Warning: XInitThreads() failed\n";
 
     if (argc < 2) {
         std::cout << "Minimal LV2 X11 host\n";
         std::cout << "Usage:\n";
-        std::cout << "  " << argv[0] << " plugin_uri [preset_number]\n";
+        std::cout << "  " << argv[0] << " [--worker-size bytes] [--no-cache] [--stats] [--stats-shm name] [--no-ftz] [--smooth ms] [--idle-bypass s] [--instances n] plugin_uri [preset_number]\n";
+        std::cout << "  " << argv[0] << " [--worker-size bytes] [--no-cache] [--stats] [--stats-shm name] [--no-ftz] [--smooth ms] [--idle-bypass s] [--autosave dir s] --chain [-j threads] uri [uri ...] [ uri | uri ... ]\n";
+        std::cout << "  --instances n runs n linked copies with one UI; the meters, atom and MIDI\n"
+                     "  output of copies 2 .. n are discarded, only their audio is used\n";
         return 0;
     }
 
@@ -125,7 +306,7 @@ int main(int argc, char *argv[]) {
     std::string preset_label;
 
     LV2X11JackHost host;
-    host.init_world();
+    host.set_use_cache(opts.use_cache);
     auto matches = host.find_plugin_matches(uri);
 
     if (matches.empty()) {
@@ -150,6 +331,9 @@ int main(int argc, char *argv[]) {
         return 0;
     }
 
+    if (opts.worker_size) host.set_worker_size(opts.worker_size);
+    host.set_denormal_protection(opts.ftz);
+    host.set_instance_count(opts.instances);
     if (!host.init(uri.c_str())) return 1;
 
     auto presets = host.get_presets(uri.c_str());
@@ -192,9 +376,18 @@ int main(int argc, char *argv[]) {
     //}
 
     if (!preset_uri.empty()) host.apply_preset(preset_uri, preset_label);
+    if (opts.smooth_ms > 0.0f) host.set_control_smoothing(opts.smooth_ms);
+    if (opts.idle_tail > 0.0f) host.set_idle_bypass(opts.idle_tail);
+    if (opts.perf_stats) {
+        host.set_perf_stats(true);
+        host.getPerf().onReport(print_perf_report);
+        if (!opts.perf_shm.empty() && !host.getPerf().exportShared(opts.perf_shm))
+            std::cerr << "Could not export stats to " << opts.perf_shm << "\n";
+    }
     if (!host.initUi()) return 1;
 
     host.run_ui_loop();
+    if (opts.perf_stats) print_perf_histogram(host.getPerf());
 
     return 0;
 }
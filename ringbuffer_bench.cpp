@@ -0,0 +1,136 @@
+/*
+ * ringbuffer_bench.cpp
+ *
+ * SPDX-License-Identifier:  BSD-3-Clause
+ *
+ * Copyright (C) 2026 brummer <brummer@web.de>
+ */
+
+/****************************************************************
+        ringbuffer_bench.cpp - lv2_ringbuffer throughput
+
+        Streams framed messages of a fixed size from a producer
+        to a consumer thread, once through the copying read
+        path and once through the zero-copy message path, and
+        reports messages and bytes per second.
+
+****************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+
+#include "lv2_ringbuffer.h"
+
+struct RunResult {
+    double seconds = 0.0;
+    uint64_t checksum = 0;
+};
+
+// producer: framed messages through lv2_ringbuffer_write_msg()
+static void produce(lv2_ringbuffer_t* rb, size_t body_size, size_t count) {
+    std::vector<uint8_t> body(body_size);
+    for (size_t i = 0; i < body_size; ++i) body[i] = (uint8_t)i;
+    const uint32_t hdr[2] = { (uint32_t)body_size, 0 };
+
+    for (size_t n = 0; n < count; ++n) {
+        body[0] = (uint8_t)n;
+        while (!lv2_ringbuffer_write_msg(rb, hdr, sizeof(hdr), body.data(), body_size))
+            std::this_thread::yield();
+    }
+}
+
+// consumer: peek the header, copy the message out, release it
+static uint64_t consume_copy(lv2_ringbuffer_t* rb, size_t count) {
+    std::vector<uint8_t> buf(LV2_RINGBUFFER_MSG_HEADER + 65536);
+    uint64_t sum = 0;
+    for (size_t n = 0; n < count;) {
+        if (lv2_ringbuffer_read_space(rb) < LV2_RINGBUFFER_MSG_HEADER) {
+            std::this_thread::yield();
+            continue;
+        }
+        uint32_t size;
+        lv2_ringbuffer_peek(rb, (char*)&size, sizeof(uint32_t));
+        const size_t total = LV2_RINGBUFFER_MSG_HEADER + size;
+        lv2_ringbuffer_peek(rb, (char*)buf.data(), total);
+        lv2_ringbuffer_release_msg(rb, total);
+        sum += buf[LV2_RINGBUFFER_MSG_HEADER];
+        ++n;
+    }
+    return sum;
+}
+
+// consumer: zero-copy access through lv2_ringbuffer_peek_msg()
+static uint64_t consume_in_place(lv2_ringbuffer_t* rb, size_t count) {
+    std::vector<uint8_t> scratch(LV2_RINGBUFFER_MSG_HEADER + 65536);
+    uint64_t sum = 0;
+    for (size_t n = 0; n < count;) {
+        size_t total;
+        const uint8_t* msg = lv2_ringbuffer_peek_msg(rb, scratch.data(), scratch.size(), &total);
+        if (!msg) {
+            std::this_thread::yield();
+            continue;
+        }
+        sum += msg[LV2_RINGBUFFER_MSG_HEADER];
+        lv2_ringbuffer_release_msg(rb, total);
+        ++n;
+    }
+    return sum;
+}
+
+static RunResult run(size_t ring_size, size_t body_size, size_t count, bool in_place) {
+    lv2_ringbuffer_t* rb = lv2_ringbuffer_create(ring_size);
+    RunResult res;
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::thread producer(produce, rb, body_size, count);
+    res.checksum = in_place ? consume_in_place(rb, count) : consume_copy(rb, count);
+    producer.join();
+    auto t1 = std::chrono::steady_clock::now();
+
+    res.seconds = std::chrono::duration<double>(t1 - t0).count();
+    lv2_ringbuffer_free(rb);
+    return res;
+}
+
+int main(int argc, char *argv[]) {
+
+    size_t ring_size = 16384;
+    size_t total_mb = 256;
+    if (argc > 1) ring_size = strtoul(argv[1], nullptr, 10);
+    if (argc > 2) total_mb = strtoul(argv[2], nullptr, 10);
+
+    if (!is_power_of_two(ring_size) || ring_size < 64 || !total_mb) {
+        std::cout << "Usage: " << argv[0] << " [ring_size (power of two)] [MB per run]\n";
+        return 1;
+    }
+
+    std::cout << "lv2_ringbuffer throughput, ring " << ring_size << " bytes, "
+              << total_mb << " MB per run\n\n";
+    std::cout << std::setw(8) << "msg" << std::setw(10) << "mode"
+              << std::setw(14) << "Mmsg/s" << std::setw(12) << "MB/s" << "\n";
+
+    const size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+    for (size_t body : sizes) {
+        const size_t frame = lv2_ringbuffer_msg_pad(LV2_RINGBUFFER_MSG_HEADER + body);
+        if (frame > ring_size) continue;
+        const size_t count = total_mb * 1024 * 1024 / frame;
+
+        for (int mode = 0; mode < 2; ++mode) {
+            RunResult r = run(ring_size, body, count, mode == 1);
+            std::cout << std::setw(8) << body << std::setw(10) << (mode ? "in-place" : "copy")
+                      << std::setw(14) << std::fixed << std::setprecision(2)
+                      << count / r.seconds / 1e6
+                      << std::setw(12) << std::setprecision(0)
+                      << count * (double)body / r.seconds / (1024 * 1024) << "\n";
+            // keep the compiler from dropping the reads
+            if (r.checksum == 1) std::cout << "";
+        }
+    }
+    return 0;
+}